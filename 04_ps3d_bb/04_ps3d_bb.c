@@ -6,7 +6,7 @@
 // https://web.archive.org/web/20200728145723/http://lonesock.net/soil.html
 //
 // Use images
-//   sprites.png : 2048 x 4096, 32bit, RGBA
+//   sprites_atlas.png : 4096 x 2048, 32bit, RGBA. made by images/atlaspack.py
 //   bg.jpg : 2560 x 1440 (24bit, RGB)
 //
 // by mieki256
@@ -16,14 +16,31 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
 #include <math.h>
+#include <string.h>
 #include <time.h>
+#include <sys/stat.h>
 #include <GL/gl.h>
 #include <GL/glu.h>
+#include <GL/glext.h>
 #include <GLFW/glfw3.h>
 #include <SOIL/SOIL.h>
 #include "glbitmfont.h"
 
+// SIMD road projection kernels. selected at run time
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define USE_SIMD
+#include <immintrin.h>
+#endif
+
+#ifdef USE_EGL
+// offscreen rendering (headless mode)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
 // #if 0
 #ifdef _WIN32
 // Windows
@@ -33,6 +50,36 @@
 #else
 // Linux
 #undef WINMM_TIMER
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// threads for the worker pool and the image loader
+#ifdef _WIN32
+typedef CRITICAL_SECTION MUTEX;
+typedef CONDITION_VARIABLE COND;
+typedef HANDLE THREAD;
+#define THREAD_FUNC DWORD WINAPI
+#define mutex_init(m) InitializeCriticalSection(m)
+#define mutex_lock(m) EnterCriticalSection(m)
+#define mutex_unlock(m) LeaveCriticalSection(m)
+#define cond_init(c) InitializeConditionVariable(c)
+#define cond_wait(c, m) SleepConditionVariableCS((c), (m), INFINITE)
+#define cond_broadcast(c) WakeAllConditionVariable(c)
+#else
+typedef pthread_mutex_t MUTEX;
+typedef pthread_cond_t COND;
+typedef pthread_t THREAD;
+#define THREAD_FUNC void *
+#define mutex_init(m) pthread_mutex_init((m), NULL)
+#define mutex_lock(m) pthread_mutex_lock(m)
+#define mutex_unlock(m) pthread_mutex_unlock(m)
+#define cond_init(c) pthread_cond_init((c), NULL)
+#define cond_wait(c, m) pthread_cond_wait((c), (m))
+#define cond_broadcast(c) pthread_cond_broadcast(c)
 #endif
 
 // window size
@@ -45,18 +92,50 @@
 #define BG2_IMG "bg_winter.jpg"
 #define BG3_IMG "bg_night.jpg"
 
-#define SPRITES_IMG "sprites.png"
-#define SPRTEXIMG_W (4096.0)
-#define SPRTEXIMG_H (4096.0)
+// sprite atlas made by images/atlaspack.py, with spr_tbl.h
+#define SPRITES_IMG "sprites_atlas.png"
 
 // Number of segments to draw
 #define VIEW_DIST 200
 
-// Maximum number of segments src
-#define SEGSRC_MAX_LIMIT 100
+// Maximum number of billboards in one frame.
+// segment sprite + 2 delineators + 4 cars per segment
+#define SPR_BATCH_MAX (VIEW_DIST * 7)
 
-// Maximum number of segments
-#define SEG_MAX_LIMIT (300 * SEGSRC_MAX_LIMIT)
+// segments after the end of the course, copied from the start.
+// VIEW_DIST segments from any index are contiguous, no wrap
+#define SEG_PAD VIEW_DIST
+
+// course arena. each array starts on a cache line
+#define ARENA_ALIGN 64
+
+// streaming course. the buffer holds STREAM_CHUNKS chunks,
+// one behind the camera and the rest generated ahead of it
+#define STREAM_CHUNK 256
+#define STREAM_CHUNKS 4
+#define STREAM_BUF_LEN (STREAM_CHUNK * STREAM_CHUNKS)
+
+// streaming course lap length in segments. a start beam marks each lap
+#define STREAM_LAP 3000
+
+// worker pool
+#define POOL_MAX_THREADS 64
+
+// image loader. decode threads, and texture rows uploaded per frame
+// for images the current frame does not need yet
+#define TEX_LOAD_THREADS 4
+#define TEX_UPLOAD_ROWS 256
+
+// texture cache file, next to each image. see tex_cache_save()
+#define TEXCACHE_EXT ".tcache"
+#define TEXCACHE_MAGIC "PS3DTEX"
+#define TEXCACHE_VERSION 3
+#define TEXCACHE_LEVELS_MAX 16
+
+// course file. see save_course()
+#define COURSE_MAGIC "PS3DCRS"
+#define COURSE_VERSION 2
+#define COURSE_ENDIAN 0x01020304
 
 #define IDEAL_FRAMERATE (60.0)
 #define DISABLE_TREE 0
@@ -64,6 +143,31 @@
 
 #define ACCEL 0
 
+// benchmark mode
+#define BENCH_SEED 1
+#define BENCH_WARMUP 10
+
+// frame profiler
+#define PROF_RING_LEN 256
+#define PROF_CSV_FILE "profile.csv"
+
+// simulation rate. frames are drawn between the last two ticks.
+// at most SIM_MAX_LAG seconds are simulated in one frame
+#define SIM_RATE (120.0)
+#define SIM_DT (1.0 / SIM_RATE)
+#define SIM_MAX_LAG (0.25)
+
+// frame pacer. sleep until PACE_SPIN (plus the learned oversleep)
+// before the target, yield until PACE_YIELD before it, then spin
+#define PACE_SPIN (0.0005)
+#define PACE_YIELD (0.0002)
+
+// OpenGL 3.3 core renderer. streaming vertex buffer ring
+#define R33_RING_LEN 3
+#define R33_RING_SIZE (1024 * 1024)
+#define R33_QUAD_MAX 16384
+#define R33_TEXT_MAX 128
+
 #define deg2rad(a) ((a) * M_PI / 180.0)
 
 // ----------------------------------------
@@ -79,8 +183,14 @@ typedef enum bbtype
   BB_HOUSE,
   BB_SLOPEL,
   BB_SLOPER,
+  BB_KIND_LEN,
 } BBTYPE;
 
+// billboard type names in course description files
+static const char *bb_name[BB_KIND_LEN] = {
+    "none", "tree", "arrowr", "arrowl", "grass", "beam", "house", "slopel", "sloper",
+};
+
 // ----------------------------------------
 // stage type
 typedef enum stagetype
@@ -92,172 +202,26 @@ typedef enum stagetype
 } STAGETYPE;
 
 // ----------------------------------------
-// sprite type
-typedef enum sprtype
-{
-
-  SPR_NONE,      // 0
-  SPR_TREE0_0,   // 1
-  SPR_TREE0_1,   // 2
-  SPR_TREE0_2,   // 3
-  SPR_TREE0_3,   // 4
-  SPR_TREE1_0,   // 5
-  SPR_TREE1_1,   // 6
-  SPR_TREE1_2,   // 7
-  SPR_TREE1_3,   // 8
-  SPR_TREE2_0,   // 9
-  SPR_TREE2_1,   // 10
-  SPR_TREE2_2,   // 11
-  SPR_TREE2_3,   // 12
-  SPR_TREE3_0,   // 13
-  SPR_TREE3_1,   // 14
-  SPR_TREE3_2,   // 15
-  SPR_TREE3_3,   // 16
-  SPR_SLOPE0_L,  // 17
-  SPR_SLOPE0_R,  // 18
-  SPR_SLOPE1_L,  // 19
-  SPR_SLOPE1_R,  // 20
-  SPR_SLOPE2_L,  // 21
-  SPR_SLOPE2_R,  // 22
-  SPR_SLOPE3_L,  // 23
-  SPR_SLOPE3_R,  // 24
-  SPR_WALL0,     // 25
-  SPR_WALL1,     // 26
-  SPR_WALL2,     // 27
-  SPR_WALL3,     // 28
-  SPR_GRASS0,    // 29
-  SPR_GRASS1,    // 30
-  SPR_GRASS2,    // 31
-  SPR_GRASS3,    // 32
-  SPR_SCOOTER0,  // 33
-  SPR_SCOOTER1,  // 34
-  SPR_SCOOTER3,  // 35
-  SPR_CAR0_0,    // 36
-  SPR_CAR0_1,    // 37
-  SPR_CAR0_2,    // 38
-  SPR_CAR3_0,    // 39
-  SPR_CAR3_1,    // 40
-  SPR_CAR3_2,    // 41
-  SPR_HOUSE0_0L, // 42
-  SPR_HOUSE0_0R, // 43
-  SPR_HOUSE0_1L, // 44
-  SPR_HOUSE0_1R, // 45
-  SPR_HOUSE0_2L, // 46
-  SPR_HOUSE0_2R, // 47
-  SPR_HOUSE2_0L, // 48
-  SPR_HOUSE2_0R, // 49
-  SPR_HOUSE2_1L, // 50
-  SPR_HOUSE2_1R, // 51
-  SPR_HOUSE2_2L, // 52
-  SPR_HOUSE2_2R, // 53
-  SPR_HOUSE3_0L, // 54
-  SPR_HOUSE3_0R, // 55
-  SPR_HOUSE3_1L, // 56
-  SPR_HOUSE3_1R, // 57
-  SPR_HOUSE3_2L, // 58
-  SPR_HOUSE3_2R, // 59
-  SPR_BEAM,      // 60
-  SPR_ARROWR2L,  // 61
-  SPR_ARROWL2R,  // 62
-  SPR_DELI0,     // 63
-  SPR_DELI1,     // 64
-  SPR_ROAD0,     // 65
-  SPR_ROAD1,     // 66
-  SPR_ROAD2,     // 67
-} SPRTYPE;
+// renderer backend
+typedef enum rendertype
+{
+  RENDER_GL11, // fixed function. fallback
+  RENDER_GL33, // core profile, shaders
+} RENDERTYPE;
 
 // ----------------------------------------
-// sprites size and uv table
-typedef struct sprtbl
-{
-  float w;
-  float h;
-  float u;
-  float v;
-  float uw;
-  float vh;
-} SPRTBL;
-
-static SPRTBL spr_tbl[68] = {
-    // poly w, poly h, u, v, uw, vh
-    {0, 0, 0.000000, 0.000000, 0.000000, 0.000000},      // 0 SPR_NONE
-    {450, 450, 0.000000, 0.000000, 0.125000, 0.125000},  // 1 SPR_TREE0_0
-    {450, 450, 0.125000, 0.000000, 0.125000, 0.125000},  // 2 SPR_TREE0_1
-    {450, 450, 0.250000, 0.000000, 0.125000, 0.125000},  // 3 SPR_TREE0_2
-    {450, 450, 0.375000, 0.000000, 0.125000, 0.125000},  // 4 SPR_TREE0_3
-    {450, 450, 0.000000, 0.125000, 0.125000, 0.125000},  // 5 SPR_TREE1_0
-    {450, 450, 0.125000, 0.125000, 0.125000, 0.125000},  // 6 SPR_TREE1_1
-    {450, 450, 0.250000, 0.125000, 0.125000, 0.125000},  // 7 SPR_TREE1_2
-    {450, 450, 0.375000, 0.125000, 0.125000, 0.125000},  // 8 SPR_TREE1_3
-    {450, 450, 0.000000, 0.250000, 0.125000, 0.125000},  // 9 SPR_TREE2_0
-    {450, 450, 0.125000, 0.250000, 0.125000, 0.125000},  // 10 SPR_TREE2_1
-    {450, 450, 0.250000, 0.250000, 0.125000, 0.125000},  // 11 SPR_TREE2_2
-    {450, 450, 0.375000, 0.250000, 0.125000, 0.125000},  // 12 SPR_TREE2_3
-    {450, 450, 0.000000, 0.375000, 0.125000, 0.125000},  // 13 SPR_TREE3_0
-    {450, 450, 0.125000, 0.375000, 0.125000, 0.125000},  // 14 SPR_TREE3_1
-    {450, 450, 0.250000, 0.375000, 0.125000, 0.125000},  // 15 SPR_TREE3_2
-    {450, 450, 0.375000, 0.375000, 0.125000, 0.125000},  // 16 SPR_TREE3_3
-    {500, 500, 0.500000, 0.000000, 0.125000, 0.125000},  // 17 SPR_SLOPE0_L
-    {500, 500, 0.625000, 0.000000, 0.125000, 0.125000},  // 18 SPR_SLOPE0_R
-    {500, 500, 0.500000, 0.125000, 0.125000, 0.125000},  // 19 SPR_SLOPE1_L
-    {500, 500, 0.625000, 0.125000, 0.125000, 0.125000},  // 20 SPR_SLOPE1_R
-    {500, 500, 0.500000, 0.250000, 0.125000, 0.125000},  // 21 SPR_SLOPE2_L
-    {500, 500, 0.625000, 0.250000, 0.125000, 0.125000},  // 22 SPR_SLOPE2_R
-    {500, 500, 0.500000, 0.375000, 0.125000, 0.125000},  // 23 SPR_SLOPE3_L
-    {500, 500, 0.625000, 0.375000, 0.125000, 0.125000},  // 24 SPR_SLOPE3_R
-    {2800, 700, 0.750000, 0.000000, 0.250000, 0.062500}, // 25 SPR_WALL0
-    {2800, 700, 0.750000, 0.125000, 0.250000, 0.062500}, // 26 SPR_WALL1
-    {2800, 700, 0.750000, 0.250000, 0.250000, 0.062500}, // 27 SPR_WALL2
-    {2800, 700, 0.750000, 0.375000, 0.250000, 0.062500}, // 28 SPR_WALL3
-    {200, 50, 0.750000, 0.062500, 0.125000, 0.031250},   // 29 SPR_GRASS0
-    {200, 50, 0.750000, 0.187500, 0.125000, 0.031250},   // 30 SPR_GRASS1
-    {200, 50, 0.750000, 0.312500, 0.125000, 0.031250},   // 31 SPR_GRASS2
-    {200, 50, 0.750000, 0.437500, 0.125000, 0.031250},   // 32 SPR_GRASS3
-    {35, 70, 0.000000, 0.500000, 0.062500, 0.125000},    // 33 SPR_SCOOTER0
-    {35, 70, 0.062500, 0.500000, 0.062500, 0.125000},    // 34 SPR_SCOOTER1
-    {35, 70, 0.125000, 0.500000, 0.062500, 0.125000},    // 35 SPR_SCOOTER3
-    {100, 100, 0.250000, 0.500000, 0.125000, 0.125000},  // 36 SPR_CAR0_0
-    {100, 100, 0.375000, 0.500000, 0.125000, 0.125000},  // 37 SPR_CAR0_1
-    {100, 100, 0.500000, 0.500000, 0.125000, 0.125000},  // 38 SPR_CAR0_2
-    {100, 100, 0.625000, 0.500000, 0.125000, 0.125000},  // 39 SPR_CAR3_0
-    {100, 100, 0.750000, 0.500000, 0.125000, 0.125000},  // 40 SPR_CAR3_1
-    {100, 100, 0.875000, 0.500000, 0.125000, 0.125000},  // 41 SPR_CAR3_2
-    {500, 375, 0.000000, 0.625000, 0.125000, 0.093750},  // 42 SPR_HOUSE0_0L
-    {500, 375, 0.125000, 0.625000, 0.125000, 0.093750},  // 43 SPR_HOUSE0_0R
-    {500, 375, 0.250000, 0.625000, 0.125000, 0.093750},  // 44 SPR_HOUSE0_1L
-    {500, 375, 0.375000, 0.625000, 0.125000, 0.093750},  // 45 SPR_HOUSE0_1R
-    {600, 300, 0.500000, 0.625000, 0.125000, 0.062500},  // 46 SPR_HOUSE0_2L
-    {600, 300, 0.500000, 0.687500, 0.125000, 0.062500},  // 47 SPR_HOUSE0_2R
-    {500, 375, 0.000000, 0.718750, 0.125000, 0.093750},  // 48 SPR_HOUSE2_0L
-    {500, 375, 0.125000, 0.718750, 0.125000, 0.093750},  // 49 SPR_HOUSE2_0R
-    {500, 375, 0.250000, 0.718750, 0.125000, 0.093750},  // 50 SPR_HOUSE2_1L
-    {500, 375, 0.375000, 0.718750, 0.125000, 0.093750},  // 51 SPR_HOUSE2_1R
-    {600, 300, 0.500000, 0.750000, 0.125000, 0.062500},  // 52 SPR_HOUSE2_2L
-    {600, 300, 0.500000, 0.812500, 0.125000, 0.062500},  // 53 SPR_HOUSE2_2R
-    {500, 375, 0.000000, 0.812500, 0.125000, 0.093750},  // 54 SPR_HOUSE3_0L
-    {500, 375, 0.125000, 0.812500, 0.125000, 0.093750},  // 55 SPR_HOUSE3_0R
-    {500, 375, 0.250000, 0.812500, 0.125000, 0.093750},  // 56 SPR_HOUSE3_1L
-    {500, 375, 0.375000, 0.812500, 0.125000, 0.093750},  // 57 SPR_HOUSE3_1R
-    {600, 300, 0.625000, 0.625000, 0.125000, 0.062500},  // 58 SPR_HOUSE3_2L
-    {600, 300, 0.625000, 0.687500, 0.125000, 0.062500},  // 59 SPR_HOUSE3_2R
-    {1000, 500, 0.750000, 0.625000, 0.250000, 0.125000}, // 60 SPR_BEAM
-    {100, 150, 0.875000, 0.906250, 0.062500, 0.093750},  // 61 SPR_ARROWR2L
-    {100, 150, 0.937500, 0.906250, 0.062500, 0.093750},  // 62 SPR_ARROWL2R
-    {20, 40, 0.812500, 0.937500, 0.031250, 0.062500},    // 63 SPR_DELI0
-    {20, 40, 0.843750, 0.937500, 0.031250, 0.062500},    // 64 SPR_DELI1
-    {256, 256, 0.531250, 0.906250, 0.062500, 0.062500},  // 65 SPR_ROAD0
-    {256, 256, 0.656250, 0.906250, 0.062500, 0.062500},  // 66 SPR_ROAD1
-    {256, 256, 0.437500, 0.937500, 0.062500, 0.062500},  // 67 SPR_ROAD2
-};
+// sprite type, and sprites size, trimmed box and uv table
+#include "spr_tbl.h"
+
+#define SPR_TBL_LEN (sizeof(spr_tbl) / sizeof(spr_tbl[0]))
 
 // ----------------------------------------
-// road texture uv position
-static float road_uv[4][4] = {
-    // u, v, uw, uh
-    {0.531250, 0.906250, 0.062500, 0.062500}, // stage 0
-    {0.531250, 0.906250, 0.062500, 0.062500}, // stage 1
-    {0.531250, 0.906250, 0.062500, 0.062500}, // stage 2
-    {0.656250, 0.906250, 0.062500, 0.062500}, // stage 3
+// road texture of each stage. 16 lines in one cell
+static const SPRTYPE road_spr[4] = {
+    SPR_ROAD0, // stage 0
+    SPR_ROAD0, // stage 1
+    SPR_ROAD0, // stage 2
+    SPR_ROAD1, // stage 3
 };
 
 // ----------------------------------------
@@ -315,33 +279,403 @@ SEGSRC segdata_src_dbg[SEGSRC_DBG_LEN] = {
 };
 
 // ----------------------------------------
-// course segment data
-typedef struct segdata
+// course segment data. structure of arrays, split by access.
+// index seg_max .. seg_max + SEG_PAD - 1 mirrors the start of the course.
+// the arrays live in gw.course, see alloc_segdata()
+// hot : read by the projection every frame
+typedef struct seghot
 {
-  float z;
-  float x;
-  float y;
-  float curve;
-  float pitch;
-  SPRTYPE sprkind;
-  float sprx;
-  float sprscale;
-  int cars;
-} SEGDATA;
+  float *z;
+  float *curve;
+  float *pitch;
+
+  // prefix sums from segment 0, this segment not included.
+  // s1 = sum of curve, s2 = sum of s1. made in expand_segdata()
+  double *curve_s1;
+  double *curve_s2;
+  double *pitch_s1;
+  double *pitch_s2;
+
+  // road texture line and delineator type. fixed per segment
+  float *attr;
+  int *deli;
+} SEGHOT;
+
+// cold : read only for segments in view
+typedef struct segcold
+{
+  SPRTYPE *sprkind;
+  float *sprx;
+  float *sprscale;
+  int *cars; // car draw flag. bit = car kind
+} SEGCOLD;
+
+// one block, carved up from the front. reset and reused on restart
+typedef struct arena
+{
+  unsigned char *buf;
+  size_t cap;
+  size_t used;
+} ARENA;
+
+// course file.
+// Header, then the expanded course arrays as they are used at run time,
+// seg_max + SEG_PAD entries each, native byte order, ARENA_ALIGN aligned.
+// Loading maps the file and points gw.seg / gw.segc into it.
+typedef enum courseary
+{
+  CA_Z,
+  CA_CURVE,
+  CA_PITCH,
+  CA_CURVE_S1,
+  CA_CURVE_S2,
+  CA_PITCH_S1,
+  CA_PITCH_S2,
+  CA_ATTR,
+  CA_DELI,
+  CA_SPRKIND,
+  CA_SPRX,
+  CA_SPRSCALE,
+  CA_LEN,
+} COURSEARY;
+
+typedef struct coursehdr
+{
+  char magic[8];       // COURSE_MAGIC
+  uint32_t endian;     // COURSE_ENDIAN as written by the saving machine
+  uint32_t version;    // COURSE_VERSION
+  uint32_t seg_max;    // segments in one lap
+  uint32_t seg_pad;    // mirrored tail. must be SEG_PAD
+  int32_t stage;       // sprites are baked for this stage
+  uint32_t spr_len;    // SPR_TBL_LEN. sprkind values are SPRTYPE of this
+  uint64_t spr_layout; // SPRATLAS_LAYOUT of the spr_tbl.h they come from
+  float seg_length;
+  double curve_s1_total;
+  double curve_s2_total;
+  double pitch_s1_total;
+  double pitch_s2_total;
+  uint64_t size;        // file size
+  uint64_t ofs[CA_LEN]; // array offsets from the start of the file
+} COURSEHDR;
+
+// what a random number is for. part of the generator key
+typedef enum rnguse
+{
+  RNG_STAGE,     // first stage
+  RNG_COURSE,    // course seed, per course generated
+  RNG_SOURCE,    // source segment count, curve, pitch, billboard type
+  RNG_BILLBOARD, // billboard placement, per source segment
+} RNGUSE;
+
+// counter-based random numbers. number n of a key is a pure function of
+// (key, n), keyed by (seed, use, index). any source segment can be
+// generated on its own, in any order, on any thread, and the same seed
+// gives the same course everywhere. squares32
+typedef struct rng
+{
+  uint64_t key;
+  uint32_t ctr;
+} RNG;
 
+// worker pool. the calling thread works too
+typedef void (*JOBFN)(void *arg, int job);
+
+typedef struct pool
+{
+  int threads; // including the caller. 1 : no workers
+  int started;
+  MUTEX mutex;
+  COND cond_work;
+  COND cond_done;
+  JOBFN fn;
+  void *arg;
+  int jobs;
+  int next;
+  int done;
+  unsigned int gen; // bumped for each pool_run()
+  int quit;
+  THREAD th[POOL_MAX_THREADS];
+} POOL;
+
+// texture images. decoded on loader threads, uploaded on the GL thread
+typedef enum teximgid
+{
+  TEX_SPR,
+  TEX_BG0,
+  TEX_BG1,
+  TEX_BG2,
+  TEX_BG3,
+  TEX_IMG_LEN,
+} TEXIMGID;
+
+typedef enum texstate
+{
+  TEX_IDLE,      // not resident
+  TEX_WAIT,      // queued
+  TEX_DECODING,  // on a loader thread
+  TEX_DECODED,   // pixels ready. the GL thread takes it from here
+  TEX_FAILED,    // cannot decode. reported by the GL thread
+  TEX_UPLOADING, // part of the rows uploaded
+  TEX_DONE,      // uploaded, or failed and reported
+} TEXSTATE;
+
+// where the pixels of a decoded image live
+typedef enum texmem
+{
+  TEXMEM_SOIL, // SOIL_load_image() as is
+  TEXMEM_HEAP, // padded or with mipmaps
+  TEXMEM_MAP,  // mapped texture cache file
+} TEXMEM;
+
+// texture residency. the sprite sheet stays, only the backgrounds of the
+// current stage and of the one being faded into are loaded
+typedef struct teximg
+{
+  const char *file;
+  GLuint *tex;    // set when the whole image is uploaded
+  GLint wrap;
+  TEXSTATE state; // under the loader mutex up to TEX_DECODED
+  int mip;        // build and use mipmaps
+  int atlas;      // sprite atlas. mipmaps up to the gutter width
+  float *uv;      // image extent (u, v) in the texture, set with *tex
+  unsigned char *pix;
+  TEXMEM mem;
+  size_t map_size;
+  int w, h, ch;   // level 0
+  int iw, ih;     // image size. smaller than w, h when padded
+  int levels;
+  size_t lofs[TEXCACHE_LEVELS_MAX]; // level offsets from pix
+  GLuint name;
+  int rows; // level 0 rows uploaded
+} TEXIMG;
+
+// texture cache file header. levels follow, each aligned to 64 bytes.
+// stale when the image file size or mtime differ
+typedef struct texcachehdr
+{
+  char magic[8];
+  uint32_t endian;
+  uint32_t version;
+  uint64_t src_size;
+  int64_t src_mtime;
+  int32_t w, h, ch, levels;
+  int32_t iw, ih;  // image size in the level 0 texture
+  uint64_t layout; // atlas layout hash. 0 : not an atlas
+  uint64_t size;   // file size
+  uint64_t ofs[TEXCACHE_LEVELS_MAX];
+} TEXCACHEHDR;
+
+typedef struct texload
+{
+  int threads;
+  int started;
+  int quit;
+  MUTEX mutex;
+  COND cond_work; // an image is queued
+  COND cond_done; // an image is decoded or failed
+  TEXIMG img[TEX_IMG_LEN];
+  THREAD th[TEX_LOAD_THREADS];
+} TEXLOAD;
+
+// random course generator state. a sharp curve is held back
+// for one source segment, the arrow sign goes first
+typedef struct cgen
+{
+  int next_cnt;
+  float next_curve;
+  float next_pitch;
+  BBTYPE next_bb;
+} CGEN;
+
+// streaming course. segments are numbered from the start of the stage,
+// buffer index i is course segment base + i
+typedef struct stream
+{
+  int enable;
+  long long base;     // course segment number of buffer index 0
+  int fill;           // expanded segments in the buffer
+  SEGSRC cur;         // source segment being expanded
+  SEGSRC next;        // the one after it. curve and pitch blend into it
+  int cur_j;          // next segment of cur to expand
+  int cur_idx;        // source number of cur
+  RNG rng;            // billboards of cur
+  int src_cnt;        // source segments generated
+  long long src_seg;  // course segment number where the next source starts
+  long long lap_due;  // course segment number from which a lap beam may start
+  long long lap_next; // course segment number of the next lap line.
+                      // LLONG_MAX until its beam is generated
+  CGEN gen;
+} STREAM;
+
+// road segments in view, near to far. written by the projection kernel
 typedef struct dt
 {
-  float x;
-  float y;
-  float z;
-  float attr;
-  int idx;
-  SPRTYPE sprkind;
-  float sprx;
-  float sprscale;
-  int deli;
+  float x[VIEW_DIST];
+  float y[VIEW_DIST];
+  float z[VIEW_DIST];
+  float attr[VIEW_DIST];
+  int deli[VIEW_DIST];
+  int idx[VIEW_DIST];
 } DT;
 
+// ----------------------------------------
+// road projection kernel
+typedef enum projkind
+{
+  PROJ_AUTO,
+  PROJ_SCALAR,
+  PROJ_SSE2,
+  PROJ_AVX2,
+  PROJ_KIND_LEN,
+} PROJKIND;
+
+// kernel input. one run of segments that does not wrap
+typedef struct projk
+{
+  float cx, xd;     // x and x slope at segment 0
+  float cy, yd;     // y and y slope at segment 0
+  float cz, zd;     // z at segment 0, segment length
+  float ofsx, ofsy; // camera shift, road height
+
+  int k0, k1; // segments k0 .. k1 - 1
+  int r0;     // segment index of k0
+  double cc, cl;
+  double pc, pl;
+} PROJK;
+
+typedef void (*PROJFN)(const PROJK *pk, DT *o);
+
+static const char *proj_name[PROJ_KIND_LEN] = {
+    "auto",
+    "scalar",
+    "sse2",
+    "avx2",
+};
+
+// ----------------------------------------
+// frame profiler phase
+typedef enum profphase
+{
+  PROF_SLEEP,  // countFps() sleep
+  PROF_UPDATE, // update() and projection loop
+  PROF_CARS,   // place_cars()
+  PROF_BG,     // draw_bg()
+  PROF_ROAD,   // draw_road()
+  PROF_TEXT,   // FPS text and profiler graph
+  PROF_SWAP,   // swap buffers
+  PROF_PHASE_LEN,
+} PROFPHASE;
+
+// frame profiler ring buffer. fixed size, no allocation
+typedef struct prof
+{
+  int enable;
+  int pos;
+  int count;
+  int frame[PROF_RING_LEN];
+  float ms[PROF_RING_LEN][PROF_PHASE_LEN];
+  double start[PROF_PHASE_LEN];
+  float pace_ms[PROF_RING_LEN]; // wake time minus target. see pace_frame()
+  char *csv_file;
+} PROF;
+
+// frame pacer. frames are released on a timeline of 1 / cfg_framerate
+// steps, not relative to the previous frame, so errors do not add up
+typedef struct pacer
+{
+  double period;    // timeline step. 0 : restart
+  double target;    // release time of the next frame
+  double oversleep; // learned sleep overshoot, seconds
+
+  // jitter of paced frames
+  int frames;
+  int late;       // target already passed, no wait
+  double err_sum; // wake time minus target, seconds
+  double err_sq;
+  double err_max;
+} PACER;
+
+// ----------------------------------------
+// GL state cache
+#define GLS_UNKNOWN 0xffffffff
+
+typedef enum glscap
+{
+  GLS_TEXTURE_2D,
+  GLS_BLEND,
+  GLS_CULL_FACE,
+  GLS_DEPTH_TEST,
+  GLS_POLYGON_OFFSET_FILL,
+  GLS_CAP_LEN,
+} GLSCAP;
+
+typedef struct glstate
+{
+  GLenum cap[GLS_CAP_LEN];
+  GLuint tex;
+  GLenum blend_src;
+  GLenum blend_dst;
+  GLenum tex_env;
+  GLenum cull_face;
+  GLenum depth_func;
+  GLenum depth_mask;
+  float poly_factor;
+  float poly_units;
+  GLuint program;
+  GLuint vao;
+
+  // number of calls sent to GL / dropped. this frame and last frame
+  int issued;
+  int saved;
+  int last_issued;
+  int last_saved;
+} GLSTATE;
+
+// ----------------------------------------
+// vertex array (glInterleavedArrays format)
+typedef struct vtxc
+{
+  float r, g, b;
+  float x, y, z;
+} VTXC; // GL_C3F_V3F
+
+typedef struct vtxt
+{
+  float u, v;
+  float x, y, z;
+} VTXT; // GL_T2F_V3F
+
+// ----------------------------------------
+// OpenGL 3.3 core renderer work
+typedef enum r33kind
+{
+  R33_COL, // VTXC. ground, fill
+  R33_TEX, // VTXT. bg, road, billboards, text
+  R33_KIND_LEN,
+} R33KIND;
+
+typedef struct r33
+{
+  GLuint prg[R33_KIND_LEN];
+  GLint u_mvp[R33_KIND_LEN];
+  GLint u_color[R33_KIND_LEN];
+  GLuint vao[R33_KIND_LEN];
+  GLuint vbo;
+  GLuint ibo;
+
+  // vbo is split into R33_RING_LEN frame regions.
+  // map != NULL : persistent mapping (GL_ARB_buffer_storage)
+  unsigned char *map;
+  GLsync fence[R33_RING_LEN];
+  int ring;
+  size_t used;
+  int overflow;
+
+  float mvp[16];
+  float color[4];
+  GLuint font_tex[GL_FONT_MAX];
+} R33;
+
 // ----------------------------------------
 // cars work
 typedef struct cars
@@ -350,6 +684,11 @@ typedef struct cars
   float x;
   float y;
   float z;
+  float rz;  // z on the segment ring, camera lap. see place_cars()
+  float dz;  // z ahead of the camera, within one lap
+  float pdz; // dz at the previous tick
+  float px;  // x at the previous tick
+  float vx;  // x drawn, between px and x
   SPRTYPE sprkind;
 } CARS;
 
@@ -377,18 +716,27 @@ typedef struct gwk
   float laps_limit;
 
   int segdata_src_len;
-  SEGSRC segdata_src[SEGSRC_MAX_LIMIT];
-
   int seg_max;
-  SEGDATA segdata[SEG_MAX_LIMIT];
 
-  DT dt[VIEW_DIST];
+  // prefix sums of the whole course (value at index seg_max)
+  double curve_s1_total;
+  double curve_s2_total;
+  double pitch_s1_total;
+  double pitch_s2_total;
+
+  PROJKIND proj_kind;
+  PROJFN proj_fn;
+  int proj_check; // --proj-check
+
+  int spr_cnt;
 
   int cars_len;
   CARS cars[4];
 
   GLuint bg_tex[4];
+  float bg_uv[4][2]; // image extent in bg_tex. below 1.0 when padded
   GLuint spr_tex;
+  TEXLOAD texload;
 
   int step;
   float camera_z;
@@ -399,6 +747,16 @@ typedef struct gwk
   float bg_y;
   float angle;
 
+  // simulation runs in SIM_DT ticks. the state at the previous tick,
+  // and the values drawn between it and the current one. see update()
+  double sim_acc;
+  float prev_camera_z;
+  float prev_bg_x;
+  float prev_bg_y;
+  float view_z;
+  float view_bg_x;
+  float view_bg_y;
+
   float seg_total_length;
 
   int disable_tree;
@@ -412,6 +770,74 @@ typedef struct gwk
   double delta;
   int count_frame;
   int count_fps;
+
+  // run mode
+  int headless;
+  int frames;
+  int frames_limit;
+  char *shot_file;
+  GLFWwindow *window;
+  RENDERTYPE renderer;
+  int no_npot;       // --npot off
+  int tex_npot;      // non power of two textures usable. see init_tex_caps()
+  int tex_max_level; // GL_TEXTURE_MAX_LEVEL usable (GL 1.2)
+  int swap_interval;
+  int fps_fix; // --fps. also paced in benchmark mode
+  unsigned int seed;
+  int stage_fix;
+  int laps_total;
+  double distance; // driven, all stages
+
+  // benchmark
+  int bench;
+  int bench_frames;
+  int bench_laps;
+  char *json_file;
+  double *bench_ftime;
+  int bench_len;
+  int bench_cap;
+  double bench_start;
+  double bench_gls_issued;
+  double bench_gls_saved;
+
+  PROF prof;
+  PACER pace;
+  GLSTATE gls;
+  R33 r33;
+
+  // large arrays. keep them after the scalars above
+
+  DT dt;
+
+  // ground and road quads. 4 vertex per segment
+  VTXC gnd_vtx[VIEW_DIST * 4];
+  VTXT road_vtx[VIEW_DIST * 4];
+
+  // billboard quads. back to front
+  VTXT spr_vtx[SPR_BATCH_MAX * 4];
+
+  // profiler graph bars
+  VTXC prof_vtx[PROF_RING_LEN * PROF_PHASE_LEN * 4];
+
+  SEGSRC *segdata_src;
+  int segdata_src_cap;
+
+  ARENA course;
+  STREAM stream;
+  unsigned int course_seed; // random course and billboards. see new_course_seed()
+  unsigned int course_num;  // courses generated since start
+
+  int threads; // --threads. 0 : number of CPUs
+  POOL pool;
+
+  // course file
+  char *course_file;
+  char *course_save_file;
+  char *course_src_file;
+  void *course_map;
+  size_t course_map_size;
+  SEGHOT seg;
+  SEGCOLD segc;
 } GWK;
 
 // reserve global work
@@ -419,1211 +845,4759 @@ static GWK gw;
 
 // ----------------------------------------
 // prototype
-int main(void);
+int main(int argc, char *argv[]);
+void parse_args(int argc, char *argv[]);
+void usage(void);
+static void open_display(void);
+static void close_display(void);
+static int display_should_close(void);
+static void swap_display(void);
+void save_screenshot(const char *filename);
+void bench_record(double ftime);
+static int bench_done(void);
+void bench_write_json(void);
+static void prof_new_frame(void);
+static void prof_start(PROFPHASE ph);
+static void prof_stop(PROFPHASE ph);
+void prof_write_csv(const char *filename);
+void draw_prof_graph(void);
 static void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
 static void resize(GLFWwindow *window, int w, int h);
 void error_callback(int error, const char *description);
 void errmsg(const char *description);
 void error_exit(const char *description);
+double get_now_time(void);
 static void initCountFps(void);
 static void closeCountFps(void);
 static float countFps(void);
 void init_work_first(void);
+void init_random(void);
+void new_course_seed(void);
+static void rng_key(RNG *r, unsigned int seed, RNGUSE use, uint64_t index);
+static int rng_next(RNG *r);
 void init_work(void);
 void init_course_random(void);
 void init_course_debug(void);
+void pool_start(int threads);
+void pool_run(JOBFN fn, void *arg, int jobs);
+void pool_stop(void);
+void alloc_segdata_src(int len);
+void alloc_segdata(int n);
+void build_course(void);
+void free_course(void);
+static void *map_file(const char *filename, size_t *size);
+static void unmap_file(void *p, size_t size);
+int save_course(const char *filename);
+void load_course(const char *filename);
+void load_course_text(const char *filename);
+void compile_course(void);
 void expand_segdata(void);
-void set_billboard(BBTYPE bbkind, int j, SPRTYPE *spr_kind, float *spr_x, float *spr_scale);
+void init_stream(void);
+void update_stream(void);
+void seg_bend(int idx, int k, float *bx, float *by);
+void init_proj_kernel(void);
+int proj_check(void);
+void init_tex_caps(void);
+void project_road(PROJK *pk, int idx);
+void set_billboard(BBTYPE bbkind, int j, RNG *rng, SPRTYPE *spr_kind, float *spr_x, float *spr_scale);
 void load_image(void);
+void tex_load_poll(void);
+void tex_load_need(TEXIMGID id);
+void tex_load_request(TEXIMGID id);
+void tex_load_release(TEXIMGID id);
+void tex_load_stage(void);
+void tex_load_stop(void);
 void update(float delta);
 void update_bg_pos(float delta, float curve, float pitch);
 void update_cars(float delta);
+void place_cars(float a);
 void draw_gl(void);
 void draw_bg(void);
 void draw_road(void);
-void draw_car(int i);
+void draw_car(int vi);
 void draw_fadeout(float a);
-void draw_billboard(int spkind, float spx, float spscale, float cx0, float y0, float z0);
+void gls_reset(void);
+void gls_new_frame(void);
+void gls_enable(GLenum cap);
+void gls_disable(GLenum cap);
+void gls_bind_texture(GLuint tex);
+void gls_blend_func(GLenum src, GLenum dst);
+void gls_tex_env(GLenum mode);
+void gls_cull_face(GLenum mode);
+void gls_depth_func(GLenum func);
+void gls_depth_mask(GLenum flag);
+void gls_polygon_offset(float factor, float units);
+void gls_use_program(GLuint prg);
+void gls_bind_vertex_array(GLuint vao);
+void r33_init(void);
+static void r33_begin_frame(void);
+static void r33_end_frame(void);
+void set_proj_3d(void);
+void set_proj_2d(void);
+void set_color(float r, float g, float b, float a);
+void draw_quads_c(VTXC *v, int n);
+void draw_quads_t(VTXT *v, int n);
+void draw_quad_fill(float v[4][3]);
+void draw_string(float x, float y, float z, char *str, int kind);
+void add_billboard(int spkind, float spx, float spscale, float cx0, float y0, float z0);
+void flush_billboards(void);
 
 // ----------------------------------------
 // Main
-int main(void)
+int main(int argc, char *argv[])
 {
-  GLFWwindow *window;
-  GLuint tex_id;
-
   init_work_first();
+  parse_args(argc, argv);
+  init_random();
+  init_proj_kernel();
 
-  glfwSetErrorCallback(error_callback);
-
-  if (!glfwInit())
+  if (gw.proj_check)
   {
-    // Initialization failed
-    errmsg("Could not initialize GLFW3");
-    exit(EXIT_FAILURE);
+    // projection kernel self check. no display
+    exit((proj_check() == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
   }
 
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 1); // set OpenGL 1.1
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
-
-  // create window
-  window = glfwCreateWindow(gw.scrw, gw.scrh, "Pseudo 3d road", NULL, NULL);
-  if (!window)
+  if (gw.course_src_file != NULL)
   {
-    // Window or OpenGL context creation failed
-    errmsg("Could not create an window");
-    glfwTerminate();
-    exit(EXIT_FAILURE);
+    // offline course compiler. no display
+    compile_course();
+    exit(EXIT_SUCCESS);
   }
 
-  glfwSetKeyCallback(window, key_callback);
-  glfwSetWindowSizeCallback(window, resize);
+  open_display();
 
-  glfwMakeContextCurrent(window);
-  glfwSwapInterval(1);
+  if (gw.renderer == RENDER_GL33)
+    r33_init();
 
+  init_tex_caps();
   load_image();
 
   initCountFps();
 
   // main loop
-  while (!glfwWindowShouldClose(window))
+  while (!display_should_close())
   {
+    prof_new_frame();
+    gls_new_frame();
+    tex_load_poll();
     gw.delta = countFps();
     update(gw.delta);
     draw_gl();
+    gw.frames++;
 
-    // glFlush();
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+    if (gw.shot_file != NULL && gw.frames == gw.frames_limit)
+      save_screenshot(gw.shot_file);
+
+    prof_start(PROF_SWAP);
+    swap_display();
+    prof_stop(PROF_SWAP);
   }
 
   closeCountFps();
 
-  glfwDestroyWindow(window);
-  glfwTerminate();
+  if (gw.prof.csv_file != NULL)
+    prof_write_csv(gw.prof.csv_file);
+
+  if (gw.bench)
+    bench_write_json();
+
+  free_course();
+  pool_stop();
+  tex_load_stop();
+  close_display();
   exit(EXIT_SUCCESS);
 }
 
 // ----------------------------------------
-// Error callback
-void error_callback(int error, const char *description)
-{
-  fprintf(stderr, "Error: %s\n", description);
-}
+// Parse command line options
 
-void errmsg(const char *description)
+// integer option value. all of val must be a number in min .. max,
+// otherwise print msg and quit
+static long long arg_num(const char *val, int base, long long min, long long max, const char *msg)
 {
-  fprintf(stderr, "Error: %s\n", description);
+  char *end;
+  long long n = strtoll(val, &end, base);
+  if (end == val || *end != '\0' || n < min || n > max)
+  {
+    errmsg(msg);
+    exit(EXIT_FAILURE);
+  }
+  return n;
 }
 
-void error_exit(const char *description)
+void parse_args(int argc, char *argv[])
 {
-  fprintf(stderr, "Error: %s\n", description);
-  glfwTerminate();
-  exit(EXIT_FAILURE);
-}
+  int seed_given = 0;
 
-// ----------------------------------------
-// Key callback
-static void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods)
-{
-  if (action == GLFW_PRESS)
+  for (int i = 1; i < argc; i++)
   {
-    if (key == GLFW_KEY_ESCAPE || key == GLFW_KEY_Q)
+    char *opt = argv[i];
+    char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+    if (strcmp(opt, "--headless") == 0)
     {
-      glfwSetWindowShouldClose(window, GLFW_TRUE);
+      gw.headless = 1;
     }
-    else if (key == GLFW_KEY_T)
+    else if (strcmp(opt, "--renderer") == 0 && val != NULL)
     {
-      gw.disable_tree = (gw.disable_tree + 1) % 2;
+      if (strcmp(val, "gl33") == 0)
+        gw.renderer = RENDER_GL33;
+      else if (strcmp(val, "gl11") == 0)
+        gw.renderer = RENDER_GL11;
+      else
+      {
+        errmsg("--renderer needs gl11 or gl33");
+        exit(EXIT_FAILURE);
+      }
+      i++;
     }
-    else if (key == GLFW_KEY_S)
+    else if (strcmp(opt, "--frames") == 0 && val != NULL)
     {
-      gw.disable_slope = (gw.disable_slope + 1) % 2;
+      gw.frames_limit = (int)arg_num(val, 10, 1, INT_MAX, "--frames needs 1 or more");
+      i++;
     }
-    else if (key == GLFW_KEY_F)
+    else if (strcmp(opt, "--shot") == 0 && val != NULL)
     {
-      if (gw.cfg_framerate == 60.0)
+      gw.shot_file = val;
+      i++;
+    }
+    else if (strcmp(opt, "--bench") == 0 && val != NULL)
+    {
+      gw.bench = 1;
+      gw.bench_frames = (int)arg_num(val, 10, 1, INT_MAX, "--bench needs 1 or more");
+      i++;
+    }
+    else if (strcmp(opt, "--bench-laps") == 0 && val != NULL)
+    {
+      gw.bench = 1;
+      gw.bench_laps = (int)arg_num(val, 10, 1, INT_MAX, "--bench-laps needs 1 or more");
+      i++;
+    }
+    else if (strcmp(opt, "--json") == 0 && val != NULL)
+    {
+      gw.json_file = val;
+      i++;
+    }
+    else if (strcmp(opt, "--seed") == 0 && val != NULL)
+    {
+      gw.seed = (unsigned int)arg_num(val, 0, 0, UINT_MAX, "--seed needs 0 - 4294967295 (or 0x...)");
+      seed_given = 1;
+      i++;
+    }
+    else if (strcmp(opt, "--stage") == 0 && val != NULL)
+    {
+      gw.stage_fix = (int)arg_num(val, 10, 0, 3, "--stage needs 0 - 3");
+      i++;
+    }
+    else if (strcmp(opt, "--proj") == 0 && val != NULL)
+    {
+      int k;
+      for (k = 0; k < PROJ_KIND_LEN; k++)
+        if (strcmp(val, proj_name[k]) == 0)
+          break;
+      if (k >= PROJ_KIND_LEN)
       {
-        gw.cfg_framerate = 30.0;
+        errmsg("--proj needs auto, scalar, sse2 or avx2");
+        exit(EXIT_FAILURE);
       }
-      else if (gw.cfg_framerate == 30.0)
+      gw.proj_kind = k;
+      i++;
+    }
+    else if (strcmp(opt, "--proj-check") == 0)
+    {
+      gw.proj_check = 1;
+    }
+    else if (strcmp(opt, "--fps") == 0 && val != NULL)
+    {
+      gw.cfg_framerate = atof(val);
+      if (!(gw.cfg_framerate >= 1.0 && gw.cfg_framerate <= 1000.0))
       {
-        gw.cfg_framerate = 20.0;
+        errmsg("--fps needs 1 - 1000");
+        exit(EXIT_FAILURE);
       }
-      else if (gw.cfg_framerate == 20.0)
+      gw.fps_fix = 1;
+      i++;
+    }
+    else if (strcmp(opt, "--npot") == 0 && val != NULL)
+    {
+      if (strcmp(val, "off") == 0)
+        gw.no_npot = 1;
+      else if (strcmp(val, "auto") == 0)
+        gw.no_npot = 0;
+      else
       {
-        gw.cfg_framerate = 60.0;
+        errmsg("--npot needs auto or off");
+        exit(EXIT_FAILURE);
       }
+      i++;
+    }
+    else if (strcmp(opt, "--threads") == 0 && val != NULL)
+    {
+      gw.threads = (int)arg_num(val, 10, 0, INT_MAX, "--threads needs 0 or more (0 : CPU count)");
+      i++;
+    }
+    else if (strcmp(opt, "--stream") == 0)
+    {
+      gw.stream.enable = 1;
+    }
+    else if (strcmp(opt, "--course") == 0 && val != NULL)
+    {
+      gw.course_file = val;
+      i++;
+    }
+    else if (strcmp(opt, "--save-course") == 0 && val != NULL)
+    {
+      gw.course_save_file = val;
+      i++;
+    }
+    else if (strcmp(opt, "--compile-course") == 0 && val != NULL)
+    {
+      gw.course_src_file = val;
+      i++;
+    }
+    else if (strcmp(opt, "--prof") == 0)
+    {
+      gw.prof.enable = 1;
+    }
+    else if (strcmp(opt, "--prof-csv") == 0 && val != NULL)
+    {
+      gw.prof.csv_file = val;
+      i++;
+    }
+    else
+    {
+      usage();
+      exit((strcmp(opt, "--help") == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
     }
   }
-}
 
-// ----------------------------------------
-// window resize callback
-static void resize(GLFWwindow *window, int w, int h)
-{
-  if (h == 0)
-    return;
+  if (gw.stream.enable && (gw.course_file != NULL || gw.course_save_file != NULL))
+  {
+    errmsg("--stream cannot be used with --course / --save-course");
+    exit(EXIT_FAILURE);
+  }
 
-  gw.scrw = w;
-  gw.scrh = h;
-  glfwSetWindowSize(window, w, h);
-  glViewport(0, 0, w, h);
-  glfwSwapInterval(1);
-  gw.fovx = gw.fovy * (float)gw.scrw / (float)gw.scrh;
+  // a loaded course is used as is, there is nothing new to save
+  if (gw.course_file != NULL && gw.course_save_file != NULL && gw.course_src_file == NULL)
+  {
+    errmsg("--course cannot be used with --save-course");
+    exit(EXIT_FAILURE);
+  }
+
+  // the stream buffer has no mirrored tail, windows near its end would
+  // project unfilled segments
+  if (gw.stream.enable && gw.proj_check)
+  {
+    errmsg("--proj-check cannot be used with --stream");
+    exit(EXIT_FAILURE);
+  }
+
+  if (gw.course_src_file != NULL && (gw.course_save_file == NULL || gw.course_file != NULL))
+  {
+    errmsg("--compile-course needs --save-course FILE");
+    exit(EXIT_FAILURE);
+  }
+
+  if (gw.shot_file != NULL && gw.frames_limit <= 0)
+  {
+    errmsg("--shot needs --frames N");
+    exit(EXIT_FAILURE);
+  }
+
+  if (gw.bench)
+  {
+    if (gw.bench_frames <= 0 && gw.bench_laps <= 0)
+    {
+      errmsg("--bench / --bench-laps needs a count");
+      exit(EXIT_FAILURE);
+    }
+
+    // same course and same stage on every run. no vsync, no sleep
+    // unless --fps is given
+    if (!seed_given)
+      gw.seed = BENCH_SEED;
+    if (gw.stage_fix < 0)
+      gw.stage_fix = STG_SUMMER;
+    gw.swap_interval = 0;
+  }
 }
 
-// ----------------------------------------
-double get_now_time(void)
+void usage(void)
 {
-#ifdef WINMM_TIMER
-  // Windows
-  return (double)(timeGetTime()) / 1000.0;
-#else
-  // Linux
-  struct timespec ts;
-  clock_gettime(CLOCK_MONOTONIC, &ts);
-  double tn = ts.tv_sec;
-  tn += (double)(ts.tv_nsec) / 1000000000.0;
-  return tn;
-#endif
+  fprintf(stderr,
+          "Usage: 04_ps3d_bb [options]\n"
+          "  --headless   render into an offscreen buffer (no window)\n"
+          "  --renderer gl11|gl33\n"
+          "               OpenGL 1.1 fixed function (default) or OpenGL 3.3 core\n"
+          "  --frames N   quit after N frames\n"
+          "  --shot FILE  save the last frame to FILE (PPM). needs --frames\n"
+          "  --bench N    benchmark. run N frames uncapped, print frame times as JSON\n"
+          "  --bench-laps N\n"
+          "               benchmark. run N laps uncapped\n"
+          "  --json FILE  write benchmark result to FILE (default: stdout)\n"
+          "  --seed N     random seed for course generation\n"
+          "  --stage N    start at stage N (0-3) and stay there\n"
+          "  --proj auto|scalar|sse2|avx2\n"
+          "               road projection kernel (default: auto)\n"
+          "  --proj-check compare the SIMD projection kernels with scalar and quit\n"
+          "  --npot auto|off\n"
+          "               native size backgrounds when supported, or always padded\n"
+          "  --fps N      frame rate limit (default: 60, vsync). paced in --bench too\n"
+          "  --threads N  worker threads for course expansion (default: CPU count)\n"
+          "  --stream     endless course generated ahead of the camera\n"
+          "  --course FILE\n"
+          "               load a course file saved by --save-course\n"
+          "  --save-course FILE\n"
+          "               save the first generated course to FILE\n"
+          "  --compile-course TXT\n"
+          "               expand course description TXT into --save-course FILE and quit\n"
+          "  --prof       show frame profiler graph\n"
+          "  --prof-csv FILE\n"
+          "               write frame profiler ring to FILE (CSV) at exit\n");
 }
 
-static void initCountFps(void)
+// ----------------------------------------
+// Display. GLFW window or offscreen EGL pbuffer
+#ifdef USE_EGL
+static EGLDisplay egl_dpy = EGL_NO_DISPLAY;
+static EGLSurface egl_surf = EGL_NO_SURFACE;
+static EGLContext egl_ctx = EGL_NO_CONTEXT;
+
+static void open_headless(void)
 {
-#ifdef WINMM_TIMER
-  timeBeginPeriod(1);
+  PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display;
+  EGLConfig config;
+  EGLint num_config, major, minor;
+
+  static const EGLint config_attr[] = {
+      EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+      EGL_RED_SIZE, 8,
+      EGL_GREEN_SIZE, 8,
+      EGL_BLUE_SIZE, 8,
+      EGL_ALPHA_SIZE, 8,
+      EGL_DEPTH_SIZE, 24,
+      EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+      EGL_NONE};
+
+  // Mesa surfaceless platform does not need a display server or a GPU
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+  get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if (get_platform_display != NULL)
+    egl_dpy = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
 #endif
+  if (egl_dpy == EGL_NO_DISPLAY)
+    egl_dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
 
-  gw.rec_time = get_now_time();
-  gw.prev_time = gw.rec_time;
-  gw.count_fps = 0;
-  gw.count_frame = 0;
+  if (egl_dpy == EGL_NO_DISPLAY || !eglInitialize(egl_dpy, &major, &minor))
+    error_exit("Could not initialize EGL");
+
+  if (!eglChooseConfig(egl_dpy, config_attr, &config, 1, &num_config) || num_config < 1)
+    error_exit("Could not find EGL config");
+
+  const EGLint pbuf_attr[] = {
+      EGL_WIDTH, gw.scrw,
+      EGL_HEIGHT, gw.scrh,
+      EGL_NONE};
+
+  egl_surf = eglCreatePbufferSurface(egl_dpy, config, pbuf_attr);
+  if (egl_surf == EGL_NO_SURFACE)
+    error_exit("Could not create EGL pbuffer");
+
+  eglBindAPI(EGL_OPENGL_API);
+  if (gw.renderer == RENDER_GL33)
+  {
+    static const EGLint ctx_attr[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE};
+
+    egl_ctx = eglCreateContext(egl_dpy, config, EGL_NO_CONTEXT, ctx_attr);
+    if (egl_ctx == EGL_NO_CONTEXT)
+    {
+      errmsg("Could not create OpenGL 3.3 core context. Use OpenGL 1.1");
+      gw.renderer = RENDER_GL11;
+    }
+  }
+  if (egl_ctx == EGL_NO_CONTEXT)
+    egl_ctx = eglCreateContext(egl_dpy, config, EGL_NO_CONTEXT, NULL);
+  if (egl_ctx == EGL_NO_CONTEXT)
+    error_exit("Could not create EGL context");
+
+  if (!eglMakeCurrent(egl_dpy, egl_surf, egl_surf, egl_ctx))
+    error_exit("Could not make EGL context current");
 }
 
-static void closeCountFps(void)
+static void close_headless(void)
 {
-#ifdef WINMM_TIMER
-  timeEndPeriod(1);
-#endif
+  eglMakeCurrent(egl_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(egl_dpy, egl_ctx);
+  eglDestroySurface(egl_dpy, egl_surf);
+  eglTerminate(egl_dpy);
 }
+#endif
 
-static float countFps(void)
+static void open_display(void)
 {
-  double t;
-  float delta;
-
-  if (gw.framerate != gw.cfg_framerate)
+  if (gw.headless)
   {
-    // sleep
-    double waittm = (gw.prev_time + (1.0 / gw.cfg_framerate)) - get_now_time();
-    if (waittm > 0.0 && waittm < 1.0)
-    {
-#ifdef WINMM_TIMER
-      waittm *= 1000;
-      Sleep((DWORD)waittm);
+#ifdef USE_EGL
+    open_headless();
+    return;
 #else
-      struct timespec ts;
-      ts.tv_sec = 0;
-      ts.tv_nsec = (long)(waittm * 1000000000);
-      nanosleep(&ts, NULL);
+    errmsg("Headless mode is not supported in this build");
+    exit(EXIT_FAILURE);
 #endif
-    }
   }
 
-  // get delta time (millisecond)
-  gw.now_time = get_now_time();
-  delta = gw.now_time - gw.prev_time;
-  if (delta <= 0 || delta >= 1.0)
-    delta = 1.0 / gw.framerate;
-  gw.prev_time = gw.now_time;
+  glfwSetErrorCallback(error_callback);
 
-  // check FPS
-  gw.count_frame++;
-  t = gw.now_time - gw.rec_time;
-  if (t >= 1.0)
+  if (!glfwInit())
   {
-    gw.rec_time += 1.0;
-    gw.count_fps = gw.count_frame;
-    gw.count_frame = 0;
+    // Initialization failed
+    errmsg("Could not initialize GLFW3");
+    exit(EXIT_FAILURE);
   }
-  else if (t < 0)
+
+  if (gw.renderer == RENDER_GL33)
   {
-    gw.rec_time = gw.now_time;
-    gw.count_fps = 0;
-    gw.count_frame = 0;
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3); // set OpenGL 3.3 core
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
+
+    gw.window = glfwCreateWindow(gw.scrw, gw.scrh, "Pseudo 3d road", NULL, NULL);
+    if (!gw.window)
+    {
+      errmsg("Could not create OpenGL 3.3 core context. Use OpenGL 1.1");
+      gw.renderer = RENDER_GL11;
+      glfwDefaultWindowHints();
+    }
   }
-  return delta;
+
+  if (gw.renderer == RENDER_GL11)
+  {
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 1); // set OpenGL 1.1
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+
+    // create window
+    gw.window = glfwCreateWindow(gw.scrw, gw.scrh, "Pseudo 3d road", NULL, NULL);
+  }
+  if (!gw.window)
+  {
+    // Window or OpenGL context creation failed
+    errmsg("Could not create an window");
+    glfwTerminate();
+    exit(EXIT_FAILURE);
+  }
+
+  glfwSetKeyCallback(gw.window, key_callback);
+  glfwSetWindowSizeCallback(gw.window, resize);
+
+  glfwMakeContextCurrent(gw.window);
+  glfwSwapInterval(gw.swap_interval);
 }
 
-void init_work_first(void)
+static void close_display(void)
 {
-  srand((unsigned)time(NULL));
+  if (gw.headless)
+  {
+#ifdef USE_EGL
+    close_headless();
+#endif
+    return;
+  }
 
-  gw.scrw = SCRW;
-  gw.scrh = SCRH;
-  gw.framerate = 60.0;
-  gw.cfg_framerate = IDEAL_FRAMERATE;
+  glfwDestroyWindow(gw.window);
+  glfwTerminate();
+}
 
-  gw.seg_length = 20.0;
-  gw.fovy = 68.0;
-  gw.fovx = gw.fovy * (float)gw.scrw / (float)gw.scrh;
-  gw.znear = gw.seg_length * 0.8;
-  gw.zfar = gw.seg_length * (VIEW_DIST + 3);
+static int display_should_close(void)
+{
+  if (gw.frames_limit > 0 && gw.frames >= gw.frames_limit)
+    return 1;
 
-  gw.road_y = -100.0;
-  gw.road_w = 300.0;
-  gw.shift_cam_x = gw.road_w * 0.45;
-  gw.spd_max = gw.seg_length * 0.8;
-  gw.spd_max_m = gw.spd_max * 0.35;
-  gw.spda = gw.spd_max / (gw.framerate * 3.0);
-  gw.laps_limit = 2;
+  if (gw.bench && bench_done())
+    return 1;
 
-  gw.disable_tree = DISABLE_TREE;
-  gw.disable_slope = DISABLE_SLOPE;
-  gw.stage_num = rand() % 4;
+  if (gw.headless)
+    return 0;
+
+  return glfwWindowShouldClose(gw.window);
 }
 
-void init_work(void)
+static void swap_display(void)
 {
-  gw.step = 0;
-  gw.camera_z = 0.0;
-
-#if ACCEL
-  gw.spd = 0.0;
-#else
-  gw.spd = gw.spd_max_m;
+  if (gw.headless)
+  {
+#ifdef USE_EGL
+    // pbuffer swap is a no-op. wait for the frame so that timing is real
+    glFinish();
 #endif
+    return;
+  }
 
-  gw.laps = 0;
-  gw.fadev = 0.0;
-  gw.bg_x = 0.0;
-  gw.bg_y = 0.0;
-  gw.angle = 0.0;
+  glfwSwapBuffers(gw.window);
+  glfwPollEvents();
+}
 
-  gw.cars_len = 4;
-  for (int i = 0; i < gw.cars_len; i++)
+// ----------------------------------------
+// Save current frame buffer to PPM file
+void save_screenshot(const char *filename)
+{
+  int w = gw.scrw;
+  int h = gw.scrh;
+  unsigned char *buf = malloc((size_t)w * h * 3);
+  if (buf == NULL)
   {
-    gw.cars[i].kind = i;
-    gw.cars[i].x = 0.0;
-    gw.cars[i].y = 0.0;
-    gw.cars[i].z = 0.0;
-    gw.cars[i].sprkind = 9;
+    errmsg("Cannot allocate screenshot buffer");
+    return;
   }
 
-  // init_course_debug();
-  init_course_random();
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, buf);
 
-  // count segment number
-  gw.seg_max = 0;
-  for (int i = 0; i < gw.segdata_src_len; i++)
-    gw.seg_max += gw.segdata_src[i].cnt;
+  FILE *fp = fopen(filename, "wb");
+  if (fp == NULL)
+  {
+    errmsg("Cannot open screenshot file");
+    free(buf);
+    return;
+  }
 
-  gw.seg_total_length = gw.seg_length * gw.seg_max;
+  // OpenGL origin is bottom-left. PPM is top-left
+  fprintf(fp, "P6\n%d %d\n255\n", w, h);
+  for (int y = h - 1; y >= 0; y--)
+    fwrite(buf + (size_t)y * w * 3, 1, (size_t)w * 3, fp);
 
-  expand_segdata();
+  fclose(fp);
+  free(buf);
 }
 
 // ----------------------------------------
-// billboard born percent table
-typedef struct
+// Benchmark. record frame times and write statistics as JSON
+void bench_record(double ftime)
 {
-  int per;
-  BBTYPE kind;
-  int min;
-  int rnd;
-} BillboardBornTbl;
+  // skip first frames. course init and texture upload are there
+  if (gw.frames < BENCH_WARMUP)
+    return;
 
-#define BB_SET_TBL_LEN 6
+  if (gw.bench_len == 0)
+    gw.bench_start = gw.now_time - ftime;
 
-static BillboardBornTbl bb_set_tbl[BB_SET_TBL_LEN] = {
-    // per, kind, min, rnd
-    {10, BB_NONE, 10, 30},
-    {50, BB_TREE, 10, 120},
-    {60, BB_GRASS, 10, 100},
-    {80, BB_HOUSE, 20, 40},
-    {90, BB_SLOPEL, 20, 40},
-    {100, BB_SLOPER, 20, 40},
-};
+  if (gw.bench_len >= gw.bench_cap)
+  {
+    int cap = (gw.bench_cap == 0) ? 4096 : gw.bench_cap * 2;
+    double *p = realloc(gw.bench_ftime, sizeof(double) * cap);
+    if (p == NULL)
+      error_exit("Cannot allocate benchmark buffer");
+    gw.bench_ftime = p;
+    gw.bench_cap = cap;
+  }
+  gw.bench_ftime[gw.bench_len++] = ftime;
+  gw.bench_gls_issued += gw.gls.last_issued;
+  gw.bench_gls_saved += gw.gls.last_saved;
+}
 
-void init_course_random(void)
+static int bench_done(void)
 {
-  gw.segdata_src_len = 20 + rand() % 25;
+  if (gw.bench_frames > 0)
+    return (gw.bench_len >= gw.bench_frames);
+  return (gw.laps_total >= gw.bench_laps);
+}
 
-  int next_cnt = 0;
-  float next_curve = 0.0;
-  float next_pitch = 0.0;
-  BBTYPE next_bb = BB_NONE;
+static int cmp_double(const void *a, const void *b)
+{
+  double da = *(const double *)a;
+  double db = *(const double *)b;
+  return (da > db) - (da < db);
+}
 
-  SEGSRC *segp = gw.segdata_src;
+static double percentile(double *sorted, int n, double per)
+{
+  // nearest-rank
+  int i = (int)ceil(per / 100.0 * n) - 1;
+  if (i < 0)
+    i = 0;
+  if (i >= n)
+    i = n - 1;
+  return sorted[i];
+}
 
-  for (int j = 0; j < gw.segdata_src_len; j++)
+// str as a JSON string, null if NULL
+static void json_string(FILE *fp, const char *str)
+{
+  if (str == NULL)
   {
-    if (j == 0)
-    {
-      segp->cnt = 25;
-      segp->curve = 0.0;
-      segp->pitch = 0.0;
-      segp->bb = BB_NONE;
-      segp++;
-      continue;
-    }
+    fputs("null", fp);
+    return;
+  }
 
-    if (j == 1)
-    {
-      segp->cnt = 28;
-      segp->curve = 0.0;
-      segp->pitch = 0.0;
-      segp->bb = BB_BEAM;
-      segp++;
-      continue;
-    }
+  fputc('"', fp);
+  for (const unsigned char *p = (const unsigned char *)str; *p != '\0'; p++)
+  {
+    if (*p == '"' || *p == '\\')
+      fprintf(fp, "\\%c", *p);
+    else if (*p < 0x20)
+      fprintf(fp, "\\u%04x", *p);
+    else
+      fputc(*p, fp);
+  }
+  fputc('"', fp);
+}
 
-    if (j >= (gw.segdata_src_len - 1))
-    {
-      segp->cnt = 50;
-      segp->curve = 0.0;
-      segp->pitch = 0.0;
-      segp->bb = BB_TREE;
-      segp++;
-      break;
-    }
+void bench_write_json(void)
+{
+  int n = gw.bench_len;
+  double sum = 0.0;
+  double sq = 0.0;
+  double total;
 
-    if (next_cnt > 0)
-    {
-      segp->cnt = next_cnt;
-      segp->curve = next_curve;
-      segp->pitch = next_pitch;
-      segp->bb = next_bb;
-      segp++;
+  if (n == 0)
+  {
+    errmsg("No benchmark frames recorded");
+    return;
+  }
 
-      next_cnt = 0;
-      next_curve = 0.0;
-      next_pitch = 0.0;
-      next_bb = BB_NONE;
-      continue;
-    }
+  total = gw.now_time - gw.bench_start;
+  for (int i = 0; i < n; i++)
+  {
+    sum += gw.bench_ftime[i];
+    sq += gw.bench_ftime[i] * gw.bench_ftime[i];
+  }
+  double var = sq / n - (sum / n) * (sum / n);
+  qsort(gw.bench_ftime, n, sizeof(double), cmp_double);
 
-    // get curve and pitch
-    float curve, pitch;
-    int r;
-    curve = 0.0;
-    pitch = 0.0;
-    r = rand() % 100;
-    if (r <= 60)
+  FILE *fp = stdout;
+  if (gw.json_file != NULL)
+  {
+    fp = fopen(gw.json_file, "w");
+    if (fp == NULL)
     {
-      curve = (float)(rand() % 300) * 0.01;
-      if (r >= 30)
-        curve *= -1.0;
+      errmsg("Cannot open json file");
+      return;
     }
+  }
 
-    r = rand() % 100;
-    if (r <= 60)
-    {
-      pitch = (float)(rand() % 40) * 0.01;
-      if (r >= 30)
-        pitch *= -1.0;
-    }
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"renderer\": ");
+  json_string(fp, (const char *)glGetString(GL_RENDERER));
+  fprintf(fp, ",\n");
+  fprintf(fp, "  \"backend\": \"%s\",\n", (gw.renderer == RENDER_GL33) ? "gl33" : "gl11");
+  fprintf(fp, "  \"headless\": %s,\n", gw.headless ? "true" : "false");
+  fprintf(fp, "  \"seed\": %u,\n", gw.seed);
+  fprintf(fp, "  \"stage\": %d,\n", gw.stage_num);
+  fprintf(fp, "  \"view_dist\": %d,\n", VIEW_DIST);
+  fprintf(fp, "  \"proj_kernel\": \"%s\",\n", proj_name[gw.proj_kind]);
+  fprintf(fp, "  \"tex_npot\": %s,\n", gw.tex_npot ? "true" : "false");
+  fprintf(fp, "  \"frames\": %d,\n", n);
+  fprintf(fp, "  \"course\": \"%s\",\n", gw.stream.enable ? "stream" : "loop");
+  fprintf(fp, "  \"laps\": %d,\n", gw.laps_total);
+  fprintf(fp, "  \"distance\": %.1f,\n", gw.distance);
+  fprintf(fp, "  \"seconds\": %.6f,\n", total);
+  fprintf(fp, "  \"fps\": %.3f,\n", (total > 0.0) ? n / total : 0.0);
+  fprintf(fp, "  \"frame_ms\": {\n");
+  fprintf(fp, "    \"min\": %.4f,\n", gw.bench_ftime[0] * 1000.0);
+  fprintf(fp, "    \"mean\": %.4f,\n", sum / n * 1000.0);
+  fprintf(fp, "    \"stddev\": %.4f,\n", sqrt((var > 0.0) ? var : 0.0) * 1000.0);
+  fprintf(fp, "    \"p50\": %.4f,\n", percentile(gw.bench_ftime, n, 50.0) * 1000.0);
+  fprintf(fp, "    \"p95\": %.4f,\n", percentile(gw.bench_ftime, n, 95.0) * 1000.0);
+  fprintf(fp, "    \"p99\": %.4f,\n", percentile(gw.bench_ftime, n, 99.0) * 1000.0);
+  fprintf(fp, "    \"max\": %.4f\n", gw.bench_ftime[n - 1] * 1000.0);
+  fprintf(fp, "  },\n");
+  fprintf(fp, "  \"gl_state_calls_per_frame\": {\n");
+  fprintf(fp, "    \"issued\": %.1f,\n", gw.bench_gls_issued / n);
+  fprintf(fp, "    \"saved\": %.1f\n", gw.bench_gls_saved / n);
+  if (gw.pace.frames > 0)
+  {
+    // --fps. release time minus the timeline
+    const PACER *pc = &gw.pace;
+    double mean = pc->err_sum / pc->frames;
+    double ev = pc->err_sq / pc->frames - mean * mean;
+    fprintf(fp, "  },\n");
+    fprintf(fp, "  \"pacing\": {\n");
+    fprintf(fp, "    \"fps\": %.3f,\n", gw.cfg_framerate);
+    fprintf(fp, "    \"frames\": %d,\n", pc->frames);
+    fprintf(fp, "    \"late\": %d,\n", pc->late);
+    fprintf(fp, "    \"err_mean_ms\": %.4f,\n", mean * 1000.0);
+    fprintf(fp, "    \"err_stddev_ms\": %.4f,\n", sqrt((ev > 0.0) ? ev : 0.0) * 1000.0);
+    fprintf(fp, "    \"err_max_ms\": %.4f,\n", pc->err_max * 1000.0);
+    fprintf(fp, "    \"oversleep_ms\": %.4f\n", pc->oversleep * 1000.0);
+  }
+  fprintf(fp, "  }\n");
+  fprintf(fp, "}\n");
 
-    // get billboard type and segment counter
-    int count = 10;
-    BBTYPE bbkind = BB_NONE;
-    r = rand() % 100;
-    for (int ti = 0; ti < BB_SET_TBL_LEN; ti++)
-    {
-      if (r <= bb_set_tbl[ti].per)
-      {
-        bbkind = bb_set_tbl[ti].kind;
-        count = bb_set_tbl[ti].min + (rand() % bb_set_tbl[ti].rnd);
-        break;
-      }
-    }
+  if (fp != stdout)
+    fclose(fp);
 
-    if (bbkind == BB_SLOPEL || bbkind == BB_SLOPER)
-    {
-      if (curve < -2.0 || curve > 2.0)
-        curve *= 0.5;
-      if (pitch < -0.5 || pitch > 0.5)
-        pitch *= 0.5;
-    }
+  free(gw.bench_ftime);
+  gw.bench_ftime = NULL;
+  gw.bench_len = gw.bench_cap = 0;
+}
 
-    if (j < (gw.segdata_src_len - 2))
-    {
-      if (curve > 1.0 || curve < -1.0)
-      {
-        // sharp curve. set road sign L or R
-
-        next_cnt = count;
-        next_curve = curve;
-        next_pitch = pitch;
-        next_bb = bbkind;
-
-        segp->cnt = 20;
-        segp->curve = 0.0;
-        segp->pitch = 0.0;
-        segp->bb = (curve > 1.0) ? BB_ARROWL : BB_ARROWR;
-        segp++;
-        continue;
-      }
-    }
+// ----------------------------------------
+// Frame profiler
+static const char *prof_name[PROF_PHASE_LEN] = {
+    "sleep",
+    "update",
+    "cars",
+    "bg",
+    "road",
+    "text",
+    "swap",
+};
 
-    segp->cnt = count;
-    segp->curve = curve;
-    segp->pitch = pitch;
-    segp->bb = bbkind;
-    segp++;
-  }
+static const float prof_col[PROF_PHASE_LEN][3] = {
+    {0.40, 0.40, 0.40}, // sleep
+    {0.20, 0.60, 1.00}, // update
+    {0.00, 0.90, 0.90}, // cars
+    {0.90, 0.80, 0.20}, // bg
+    {1.00, 0.40, 0.20}, // road
+    {0.80, 0.40, 1.00}, // text
+    {0.30, 0.90, 0.30}, // swap
+};
+
+static void prof_new_frame(void)
+{
+  PROF *p = &gw.prof;
+  p->pos = (p->pos + 1) % PROF_RING_LEN;
+  if (p->count < PROF_RING_LEN)
+    p->count++;
+  p->frame[p->pos] = gw.frames;
+  for (int i = 0; i < PROF_PHASE_LEN; i++)
+    p->ms[p->pos][i] = 0.0;
 }
 
-void init_course_debug(void)
+static void prof_start(PROFPHASE ph)
 {
-  gw.segdata_src_len = SEGSRC_DBG_LEN;
-  for (int i = 0; i < gw.segdata_src_len; i++)
-  {
-    gw.segdata_src[i].cnt = segdata_src_dbg[i].cnt;
-    gw.segdata_src[i].curve = segdata_src_dbg[i].curve;
-    gw.segdata_src[i].pitch = segdata_src_dbg[i].pitch;
-    gw.segdata_src[i].bb = segdata_src_dbg[i].bb;
-  }
+  gw.prof.start[ph] = get_now_time();
 }
 
-void expand_segdata(void)
+static void prof_stop(PROFPHASE ph)
 {
-  float z = 0.0;
-  SEGDATA *segp = gw.segdata;
-  for (int i = 0; i < gw.segdata_src_len; i++)
+  gw.prof.ms[gw.prof.pos][ph] += (float)((get_now_time() - gw.prof.start[ph]) * 1000.0);
+}
+
+void prof_write_csv(const char *filename)
+{
+  PROF *p = &gw.prof;
+  FILE *fp = fopen(filename, "w");
+  if (fp == NULL)
   {
-    int i2, cnt;
-    BBTYPE bbkind;
-    float curve, pitch, next_curve, next_pitch;
+    errmsg("Cannot open profiler csv file");
+    return;
+  }
 
-    i2 = (i + 1) % gw.segdata_src_len;
-    cnt = gw.segdata_src[i].cnt;
-    curve = gw.segdata_src[i].curve;
-    pitch = -gw.segdata_src[i].pitch;
-    bbkind = gw.segdata_src[i].bb;
-    next_curve = gw.segdata_src[i2].curve;
-    next_pitch = -gw.segdata_src[i2].pitch;
+  fprintf(fp, "frame");
+  for (int i = 0; i < PROF_PHASE_LEN; i++)
+    fprintf(fp, ",%s_ms", prof_name[i]);
+  fprintf(fp, ",total_ms,pace_err_ms\n");
 
-    for (int j = 0; j < cnt; j++)
+  // oldest first
+  for (int n = p->count - 1; n >= 0; n--)
+  {
+    int k = (p->pos - n + PROF_RING_LEN) % PROF_RING_LEN;
+    float total = 0.0;
+    fprintf(fp, "%d", p->frame[k]);
+    for (int i = 0; i < PROF_PHASE_LEN; i++)
     {
-      float ratio, c, p, sprx, sprscale;
-      SPRTYPE sprkind;
-
-      sprkind = SPR_NONE;
-      sprx = 0.0;
-      sprscale = 1.0;
-
-      ratio = (float)j / (float)cnt;
-      c = curve + ((next_curve - curve) * ratio);
-      p = pitch + ((next_pitch - pitch) * ratio);
-
-      set_billboard(bbkind, j, &sprkind, &sprx, &sprscale);
-
-      segp->z = z;
-      segp->x = 0.0;
-      segp->y = 0.0;
-      segp->curve = c;
-      segp->pitch = p;
-      segp->sprkind = sprkind;
-      segp->sprx = sprx;
-      segp->sprscale = sprscale;
-      segp->cars = 0;
-      segp++;
-      z += gw.seg_length;
+      fprintf(fp, ",%.4f", p->ms[k][i]);
+      total += p->ms[k][i];
     }
+    fprintf(fp, ",%.4f,%.4f\n", total, p->pace_ms[k]);
   }
-}
 
-static SPRTYPE house_tbl[4][2][3] = {
-    {
-        // stage 0
-        {SPR_HOUSE0_0L, SPR_HOUSE0_1L, SPR_HOUSE0_2L},
-        {SPR_HOUSE0_0R, SPR_HOUSE0_1R, SPR_HOUSE0_2R},
-    },
-    {
-        // stage 1
-        {SPR_HOUSE0_0L, SPR_HOUSE0_1L, SPR_HOUSE0_2L},
-        {SPR_HOUSE0_0R, SPR_HOUSE0_1R, SPR_HOUSE0_2R},
-    },
-    {
-        // stage 2
-        {SPR_HOUSE2_0L, SPR_HOUSE2_1L, SPR_HOUSE2_2L},
-        {SPR_HOUSE2_0R, SPR_HOUSE2_1R, SPR_HOUSE2_2R},
-    },
-    {
-        // stage 3
-        {SPR_HOUSE3_0L, SPR_HOUSE3_1L, SPR_HOUSE3_2L},
-        {SPR_HOUSE3_0R, SPR_HOUSE3_1R, SPR_HOUSE3_2R},
-    },
-};
+  fclose(fp);
+}
 
-void set_billboard(BBTYPE bbkind, int j, SPRTYPE *spr_kind, float *spr_x, float *spr_scale)
+// draw rolling stacked bar graph. screen pixel coordinates
+void draw_prof_graph(void)
 {
-  *spr_kind = 0;
-  *spr_x = 0.0;
-  *spr_scale = 1.0;
+  PROF *p = &gw.prof;
+  float bw = 1.0;                       // bar width (pixel)
+  float gh = 100.0;                     // graph height (pixel)
+  float scale = gh / (1000.0 / 30.0);   // graph top = 33.3 ms
+  float x0 = gw.scrw * 0.5 + 80.0;      // right of FPS text
+  float y0 = 8.0 + gh;                  // bottom line
 
-  if (bbkind == BB_NONE)
-    return;
+  float gx1 = x0 + bw * PROF_RING_LEN;  // graph right
+  float y60 = y0 - (1000.0 / 60.0) * scale;
 
-  if (bbkind == BB_TREE && gw.disable_tree != 0)
-    bbkind = BB_GRASS;
+  set_proj_2d();
 
-  if ((bbkind == BB_SLOPEL || bbkind == BB_SLOPER) && gw.disable_slope != 0)
-    bbkind = BB_GRASS;
+  gls_disable(GL_TEXTURE_2D);
+  gls_disable(GL_CULL_FACE);
+  gls_enable(GL_BLEND);
+  gls_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-  switch (bbkind)
+  // background
   {
-  case BB_TREE:
-    *spr_kind = SPR_TREE0_0 + (rand() % 4) + (gw.stage_num * 4);
-    *spr_x = (float)(rand() % 450) + gw.road_w + 150.0;
-    if (rand() % 2 == 0)
-      *spr_x *= -1.0;
-    *spr_scale = (float)(100 + rand() % 100) * 0.01;
-    break;
+    float q[4][3] = {{x0, y0 - gh, 0}, {x0, y0, 0}, {gx1, y0, 0}, {gx1, y0 - gh, 0}};
+    set_color(0, 0, 0, 0.5);
+    draw_quad_fill(q);
+  }
 
-  case BB_ARROWR:
-  case BB_ARROWL:
-    if (j % 4 == 2)
+  // bars. oldest on the left. skip current frame, it is not finished
+  VTXC *vp = gw.prof_vtx;
+  for (int n = p->count - 1; n >= 1; n--)
+  {
+    int k = (p->pos - n + PROF_RING_LEN) % PROF_RING_LEN;
+    float x = x0 + bw * (PROF_RING_LEN - n);
+    float y = y0;
+    for (int i = 0; i < PROF_PHASE_LEN; i++)
     {
-      // arrow sign
-      *spr_kind = SPR_ARROWR2L + (bbkind - BB_ARROWR);
-      *spr_x = gw.road_w + 150.0;
+      const float *col = prof_col[i];
+      float h = p->ms[k][i] * scale;
+      if (y - h < y0 - gh)
+        h = y - (y0 - gh);
+      if (h <= 0.0)
+        continue;
+      vp[0] = (VTXC){col[0], col[1], col[2], x, y - h, 0};
+      vp[1] = (VTXC){col[0], col[1], col[2], x, y, 0};
+      vp[2] = (VTXC){col[0], col[1], col[2], x + bw, y, 0};
+      vp[3] = (VTXC){col[0], col[1], col[2], x + bw, y - h, 0};
+      vp += 4;
+      y -= h;
     }
-    else
-    {
-      // grass
-      *spr_kind = SPR_GRASS0 + (gw.stage_num * 1);
-      *spr_x = gw.road_w + 150.0 + (rand() % 60) - 30;
+  }
+  draw_quads_c(gw.prof_vtx, (vp - gw.prof_vtx) / 4);
+
+  // 60 FPS and 30 FPS lines. 1 pixel high quads
+  {
+    float q60[4][3] = {{x0, y60, 0}, {x0, y60 + 1, 0}, {gx1, y60 + 1, 0}, {gx1, y60, 0}};
+    float q30[4][3] = {{x0, y0 - gh, 0}, {x0, y0 - gh + 1, 0}, {gx1, y0 - gh + 1, 0}, {gx1, y0 - gh, 0}};
+    set_color(1, 1, 1, 0.6);
+    draw_quad_fill(q60);
+    draw_quad_fill(q30);
+  }
+
+  gls_disable(GL_BLEND);
+
+  // legend. last finished frame
+  {
+    int k = (p->pos - 1 + PROF_RING_LEN) % PROF_RING_LEN;
+    char buf[64];
+    float x = gx1 + 8.0;
+    for (int i = 0; i < PROF_PHASE_LEN; i++)
+    {
+      sprintf(buf, "%-6s %6.2f", prof_name[i], p->ms[k][i]);
+      set_color(prof_col[i][0], prof_col[i][1], prof_col[i][2], 1);
+      draw_string(x, 8.0 + 16.0 * (i + 1), 0, buf, GL_FONT_SHNM8x16R);
     }
-    if (bbkind == BB_ARROWL)
-      *spr_x *= -1.0;
-    *spr_scale = 1.0;
-    break;
 
-  case BB_GRASS:
-    *spr_kind = SPR_GRASS0 + (gw.stage_num * 1);
-    *spr_x = (rand() % 300) + gw.road_w + 250.0;
-    if (rand() % 2 == 0)
-      *spr_x *= -1.0;
-    *spr_scale = (float)(50 + rand() % 150) * 0.01;
-    break;
+    // GL state calls. saved / issued
+    sprintf(buf, "glstate %3d/%3d", gw.gls.last_saved, gw.gls.last_issued);
+    set_color(1, 1, 1, 1);
+    draw_string(x, 8.0 + 16.0 * (PROF_PHASE_LEN + 1), 0, buf, GL_FONT_SHNM8x16R);
 
-  case BB_BEAM:
-    *spr_kind = 0;
-    *spr_x = 0;
-    *spr_scale = 1.0;
-    if (j % 10 == 0)
-      *spr_kind = SPR_BEAM;
-    break;
+    // pacer. wake time minus target, learned oversleep
+    sprintf(buf, "pace %+6.3f", p->pace_ms[k]);
+    draw_string(x, 8.0 + 16.0 * (PROF_PHASE_LEN + 2), 0, buf, GL_FONT_SHNM8x16R);
+    sprintf(buf, "over %6.3f", gw.pace.oversleep * 1000.0);
+    draw_string(x, 8.0 + 16.0 * (PROF_PHASE_LEN + 3), 0, buf, GL_FONT_SHNM8x16R);
+  }
 
-  case BB_HOUSE:
-    if (j % 12 == 4)
+  set_proj_3d();
+}
+
+// ----------------------------------------
+// Error callback
+void error_callback(int error, const char *description)
+{
+  fprintf(stderr, "Error: %s\n", description);
+}
+
+void errmsg(const char *description)
+{
+  fprintf(stderr, "Error: %s\n", description);
+}
+
+void error_exit(const char *description)
+{
+  fprintf(stderr, "Error: %s\n", description);
+  glfwTerminate();
+  exit(EXIT_FAILURE);
+}
+
+// ----------------------------------------
+// Key callback
+static void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods)
+{
+  if (action == GLFW_PRESS)
+  {
+    if (key == GLFW_KEY_ESCAPE || key == GLFW_KEY_Q)
     {
-      // house
-      *spr_x = -(float)(gw.road_w + 450 + rand() % 100);
-      *spr_scale = 1.0;
-      int lr = (rand() % 2 == 0) ? 0 : 1;
-      *spr_kind = house_tbl[gw.stage_num][lr][rand() % 3];
-      *spr_x *= ((lr == 0) ? 1.0 : -1.0);
+      glfwSetWindowShouldClose(window, GLFW_TRUE);
     }
-    else
+    else if (key == GLFW_KEY_T)
     {
-      // tree or none
-      if (j % 2 == 0)
-      {
-        // tree
-        *spr_kind = SPR_TREE0_0 + (rand() % 4) + (gw.stage_num * 4);
-        *spr_x = (float)(rand() % 500) + gw.road_w + 400.0;
-        if (rand() % 2 == 0)
-          *spr_x *= -1.0;
-        *spr_scale = (float)(100 + rand() % 100) * 0.01;
-      }
-      else
-      {
-        // none
-        *spr_kind = SPR_NONE;
-      }
+      gw.disable_tree = (gw.disable_tree + 1) % 2;
     }
-    break;
-
-  case BB_SLOPEL:
-    *spr_scale = 1.0;
-    if (j == 0)
+    else if (key == GLFW_KEY_S)
     {
-      // trees wall
-      *spr_kind = SPR_WALL0 + (gw.stage_num * 1);
-      *spr_x = -(gw.road_w * 6.0);
+      gw.disable_slope = (gw.disable_slope + 1) % 2;
     }
-    else
+    else if (key == GLFW_KEY_P)
     {
-      if (j % 2 == 0)
-      {
-        // slope L
-        *spr_kind = SPR_SLOPE0_L + (gw.stage_num * 2);
-        *spr_x = -(gw.road_w * 1.5);
-      }
-      else
-      {
-        // tree
-        *spr_kind = SPR_TREE0_0 + (rand() % 4) + (gw.stage_num * 4);
-        *spr_x = (float)(rand() % 600) + gw.road_w + 300.0;
-        *spr_scale = (float)(100 + rand() % 100) * 0.01;
-      }
+      gw.prof.enable = (gw.prof.enable + 1) % 2;
     }
-    break;
-
-  case BB_SLOPER:
-    *spr_scale = 1.0;
-    if (j == 0)
+    else if (key == GLFW_KEY_C)
     {
-      // trees wall
-      *spr_kind = SPR_WALL0 + (gw.stage_num * 1);
-      *spr_x = (gw.road_w * 6.0);
+      prof_write_csv((gw.prof.csv_file != NULL) ? gw.prof.csv_file : PROF_CSV_FILE);
     }
-    else
+    else if (key == GLFW_KEY_F)
     {
-      if (j % 2 == 0)
+      if (gw.cfg_framerate == 60.0)
       {
-        // slope R
-        *spr_kind = SPR_SLOPE0_R + (gw.stage_num * 2);
-        *spr_x = (gw.road_w * 1.5);
+        gw.cfg_framerate = 30.0;
       }
-      else
+      else if (gw.cfg_framerate == 30.0)
       {
-        // tree
-        *spr_kind = SPR_TREE0_0 + (rand() % 4) + (gw.stage_num * 4);
-        *spr_x = -((float)(rand() % 600) + gw.road_w + 300.0);
-        *spr_scale = (float)(100 + rand() % 100) * 0.01;
+        gw.cfg_framerate = 20.0;
+      }
+      else if (gw.cfg_framerate == 20.0)
+      {
+        gw.cfg_framerate = 60.0;
       }
     }
-    break;
-
-  default:
-    break;
   }
 }
 
-static char *bgimgs[4] = {
-    BG0_IMG,
-    BG1_IMG,
-    BG2_IMG,
-    BG3_IMG,
-};
+// ----------------------------------------
+// window resize callback
+static void resize(GLFWwindow *window, int w, int h)
+{
+  if (h == 0)
+    return;
 
-void load_image(void)
+  gw.scrw = w;
+  gw.scrh = h;
+  glfwSetWindowSize(window, w, h);
+  glViewport(0, 0, w, h);
+  glfwSwapInterval(gw.swap_interval);
+  gw.fovx = gw.fovy * (float)gw.scrw / (float)gw.scrh;
+}
+
+// ----------------------------------------
+double get_now_time(void)
 {
-  // load texture image file. use SOIL
-  gw.spr_tex = SOIL_load_OGL_texture(SPRITES_IMG, SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, SOIL_FLAG_POWER_OF_TWO);
-  if (gw.spr_tex > 0)
+#ifdef WINMM_TIMER
+  // Windows. performance counter, timeGetTime() steps by 1 ms
+  static double freq = 0.0;
+  LARGE_INTEGER c;
+  if (freq == 0.0)
   {
-    glEnable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, gw.spr_tex);
+    LARGE_INTEGER f;
+    QueryPerformanceFrequency(&f);
+    freq = (double)f.QuadPart;
   }
-  else
+  QueryPerformanceCounter(&c);
+  return (double)c.QuadPart / freq;
+#else
+  // Linux
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  double tn = ts.tv_sec;
+  tn += (double)(ts.tv_nsec) / 1000000000.0;
+  return tn;
+#endif
+}
+
+static void initCountFps(void)
+{
+#ifdef WINMM_TIMER
+  timeBeginPeriod(1);
+#endif
+
+  gw.rec_time = get_now_time();
+  gw.prev_time = gw.rec_time;
+  gw.count_fps = 0;
+  gw.count_frame = 0;
+  gw.pace.period = 0.0;
+}
+
+static void closeCountFps(void)
+{
+#ifdef WINMM_TIMER
+  timeEndPeriod(1);
+#endif
+}
+
+static void sleep_sec(double sec)
+{
+#ifdef WINMM_TIMER
+  Sleep((DWORD)(sec * 1000.0));
+#else
+  struct timespec ts;
+  ts.tv_sec = (time_t)sec;
+  ts.tv_nsec = (long)((sec - (double)ts.tv_sec) * 1000000000);
+  if (ts.tv_nsec > 999999999)
+    ts.tv_nsec = 999999999;
+  nanosleep(&ts, NULL);
+#endif
+}
+
+static void yield_thread(void)
+{
+#ifdef _WIN32
+  SwitchToThread();
+#else
+  sched_yield();
+#endif
+}
+
+// wait for the next point of the timeline. a coarse sleep that ends
+// early by the oversleep the OS has shown, then yield and spin
+static void pace_frame(void)
+{
+  PACER *pc = &gw.pace;
+  double period = 1.0 / gw.cfg_framerate;
+  double now = get_now_time();
+
+  if (pc->period != period)
   {
-    errmsg("Cannot load road image");
-    glDisable(GL_TEXTURE_2D);
+    // first frame or rate changed
+    pc->period = period;
+    pc->target = now;
+    return;
   }
 
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-  glEnable(GL_BLEND);
-
-  for (int i = 0; i < 4; i++)
+  pc->target += period;
+  if (now >= pc->target)
+  {
+    // late. release now
+    if (gw.frames >= BENCH_WARMUP)
+      pc->late++;
+  }
+  else
   {
-    gw.bg_tex[i] = SOIL_load_OGL_texture(bgimgs[i], SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, SOIL_FLAG_POWER_OF_TWO);
-    if (gw.bg_tex[i] > 0)
+    double sl = pc->target - now - pc->oversleep - PACE_SPIN;
+    if (sl > 0.0)
     {
-      glEnable(GL_TEXTURE_2D);
-      glBindTexture(GL_TEXTURE_2D, gw.bg_tex[i]);
+      sleep_sec(sl);
+      double t = get_now_time();
+      double over = (t - now) - sl;
+      if (over < 0.0)
+        over = 0.0;
+      if (over > period / 2)
+        over = period / 2;
+      // rises fast, decays slowly. follows the worst recent cases
+      pc->oversleep += (over - pc->oversleep) * ((over > pc->oversleep) ? 0.5 : 0.02);
+      now = t;
     }
-    else
+    while (now < pc->target)
     {
-      errmsg("Cannot load bg image");
-      glDisable(GL_TEXTURE_2D);
+      if (pc->target - now > PACE_YIELD)
+        yield_thread();
+      now = get_now_time();
     }
   }
-}
 
-void update(float delta)
-{
-  switch (gw.step)
+  // statistics skip the first frames, like the benchmark
+  double err = now - pc->target;
+  if (gw.frames >= BENCH_WARMUP)
   {
-  case 0:
-    // init work
-    init_work();
-    gw.fadev = 1.0;
-    gw.step++;
-    break;
-  case 1:
-    // fadein
-    gw.fadev -= ((1.0 / (gw.framerate * 1.3)) * gw.framerate * delta);
-    if (gw.fadev <= 0.0)
-    {
-      gw.fadev = 0.0;
-      gw.step++;
-    }
-    break;
-  case 2:
-    // main job
-    if (gw.laps >= gw.laps_limit)
-    {
-      gw.fadev = 0.0;
-      gw.step++;
-    }
-    break;
-  case 3:
-    // fadeout
-    gw.fadev += ((1.0 / (gw.framerate * 2.0)) * gw.framerate * delta);
-    if (gw.fadev >= 1.0)
-    {
-      gw.fadev = 1.0;
-      gw.laps = 0;
-      gw.step = 0;
-      gw.stage_num = (gw.stage_num + 1) % 4;
-    }
-    break;
-  default:
-    break;
+    pc->frames++;
+    pc->err_sum += err;
+    pc->err_sq += err * err;
+    if (err > pc->err_max)
+      pc->err_max = err;
   }
+  gw.prof.pace_ms[gw.prof.pos] = (float)(err * 1000.0);
 
-#if ACCEL
-  gw.spd += (gw.spda * gw.framerate * delta);
-#endif
+  // a whole period behind. drop the missed slots, no burst of frames
+  if (err > period)
+    pc->target = now;
+}
 
-  if (gw.spd >= gw.spd_max_m)
-    gw.spd = gw.spd_max_m;
+static float countFps(void)
+{
+  double t;
+  float delta;
 
-  // move camera
-  gw.camera_z += (gw.spd * gw.framerate * delta);
-  if (gw.camera_z >= gw.seg_total_length)
+  prof_start(PROF_SLEEP);
+  gw.prof.pace_ms[gw.prof.pos] = 0.0;
+  if ((gw.framerate != gw.cfg_framerate || gw.fps_fix) && (!gw.bench || gw.fps_fix))
+    pace_frame();
+  prof_stop(PROF_SLEEP);
+
+  // get delta time (millisecond)
+  gw.now_time = get_now_time();
+  delta = gw.now_time - gw.prev_time;
+  if (gw.bench)
   {
-    gw.camera_z -= gw.seg_total_length;
-    gw.laps++;
+    // measure real frame time, but move by fixed step.
+    // every machine draws the same frames
+    bench_record(delta);
+    delta = 1.0 / gw.framerate;
+  }
+  if (delta <= 0 || delta >= 1.0)
+    delta = 1.0 / gw.framerate;
+  gw.prev_time = gw.now_time;
+
+  // check FPS
+  gw.count_frame++;
+  t = gw.now_time - gw.rec_time;
+  if (t >= 1.0)
+  {
+    gw.rec_time += 1.0;
+    gw.count_fps = gw.count_frame;
+    gw.count_frame = 0;
+  }
+  else if (t < 0)
+  {
+    gw.rec_time = gw.now_time;
+    gw.count_fps = 0;
+    gw.count_frame = 0;
+  }
+  return delta;
+}
+
+void init_work_first(void)
+{
+  gw.seed = (unsigned int)time(NULL);
+  gw.stage_fix = -1;
+  gw.swap_interval = 1;
+
+  gw.scrw = SCRW;
+  gw.scrh = SCRH;
+  gw.framerate = 60.0;
+  gw.cfg_framerate = IDEAL_FRAMERATE;
+
+  gw.seg_length = 20.0;
+  gw.fovy = 68.0;
+  gw.fovx = gw.fovy * (float)gw.scrw / (float)gw.scrh;
+  gw.znear = gw.seg_length * 0.8;
+  gw.zfar = gw.seg_length * (VIEW_DIST + 3);
+
+  gw.road_y = -100.0;
+  gw.road_w = 300.0;
+  gw.shift_cam_x = gw.road_w * 0.45;
+  gw.spd_max = gw.seg_length * 0.8;
+  gw.spd_max_m = gw.spd_max * 0.35;
+  gw.spda = gw.spd_max / (gw.framerate * 3.0);
+  gw.laps_limit = 2;
+
+  gw.disable_tree = DISABLE_TREE;
+  gw.disable_slope = DISABLE_SLOPE;
+}
+
+void init_random(void)
+{
+  RNG r;
+  rng_key(&r, gw.seed, RNG_STAGE, 0);
+  gw.stage_num = (gw.stage_fix >= 0) ? gw.stage_fix : (rng_next(&r) % 4);
+  gw.course_num = 0;
+}
+
+// each new course of the run gets its own seed
+void new_course_seed(void)
+{
+  RNG r;
+  rng_key(&r, gw.seed, RNG_COURSE, gw.course_num++);
+  gw.course_seed = (unsigned int)rng_next(&r);
+}
+
+void init_work(void)
+{
+  gw.step = 0;
+  gw.camera_z = 0.0;
+
+#if ACCEL
+  gw.spd = 0.0;
+#else
+  gw.spd = gw.spd_max_m;
+#endif
+
+  gw.laps = 0;
+  gw.fadev = 0.0;
+  gw.bg_x = 0.0;
+  gw.bg_y = 0.0;
+  gw.angle = 0.0;
+
+  gw.cars_len = 4;
+  for (int i = 0; i < gw.cars_len; i++)
+  {
+    gw.cars[i].kind = i;
+    gw.cars[i].x = 0.0;
+    gw.cars[i].y = 0.0;
+    gw.cars[i].z = 0.0;
+    gw.cars[i].sprkind = 9;
+  }
+
+  if (gw.stream.enable)
+  {
+    init_stream();
+    return;
+  }
+
+  if (gw.course_file != NULL)
+  {
+    load_course(gw.course_file);
+    return;
+  }
+
+  // init_course_debug();
+  new_course_seed();
+  init_course_random();
+  build_course();
+
+  if (gw.course_save_file != NULL)
+  {
+    save_course(gw.course_save_file);
+    gw.course_save_file = NULL;
+  }
+}
+
+// expand gw.segdata_src into the course arrays
+void build_course(void)
+{
+  // count segment number
+  long long cnt = 0;
+  for (int i = 0; i < gw.segdata_src_len; i++)
+    cnt += gw.segdata_src[i].cnt;
+  if (cnt <= 0 || cnt > INT_MAX - SEG_PAD)
+    error_exit("Course segment count is out of range");
+  gw.seg_max = (int)cnt;
+
+  gw.seg_total_length = gw.seg_length * gw.seg_max;
+
+  alloc_segdata(gw.seg_max);
+  expand_segdata();
+}
+
+// ----------------------------------------
+// worker pool
+
+static int cpu_count(void)
+{
+#ifdef _WIN32
+  SYSTEM_INFO si;
+  GetSystemInfo(&si);
+  return (int)si.dwNumberOfProcessors;
+#else
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return (n > 0) ? (int)n : 1;
+#endif
+}
+
+// take jobs until none are left. called with the mutex held
+static void pool_work(POOL *pl)
+{
+  while (pl->next < pl->jobs)
+  {
+    int job = pl->next++;
+    mutex_unlock(&pl->mutex);
+    pl->fn(pl->arg, job);
+    mutex_lock(&pl->mutex);
+    if (++pl->done == pl->jobs)
+      cond_broadcast(&pl->cond_done);
+  }
+}
+
+static THREAD_FUNC pool_worker(void *arg)
+{
+  POOL *pl = arg;
+  unsigned int seen = 0;
+
+  mutex_lock(&pl->mutex);
+  while (!pl->quit)
+  {
+    if (pl->gen == seen)
+    {
+      cond_wait(&pl->cond_work, &pl->mutex);
+      continue;
+    }
+    seen = pl->gen;
+    pool_work(pl);
+  }
+  mutex_unlock(&pl->mutex);
+  return 0;
+}
+
+// threads <= 0 : one per CPU
+void pool_start(int threads)
+{
+  POOL *pl = &gw.pool;
+  if (pl->started)
+    return;
+
+  if (threads <= 0)
+    threads = cpu_count();
+  if (threads > POOL_MAX_THREADS)
+    threads = POOL_MAX_THREADS;
+
+  mutex_init(&pl->mutex);
+  cond_init(&pl->cond_work);
+  cond_init(&pl->cond_done);
+  pl->started = 1;
+  pl->threads = 1;
+  for (int i = 0; i < threads - 1; i++)
+  {
+#ifdef _WIN32
+    pl->th[i] = CreateThread(NULL, 0, pool_worker, pl, 0, NULL);
+    if (pl->th[i] == NULL)
+      break;
+#else
+    if (pthread_create(&pl->th[i], NULL, pool_worker, pl) != 0)
+      break;
+#endif
+    pl->threads++;
+  }
+}
+
+// fn(arg, 0 .. jobs - 1) on the pool. returns when all are done
+void pool_run(JOBFN fn, void *arg, int jobs)
+{
+  POOL *pl = &gw.pool;
+  pool_start(gw.threads);
+
+  if (pl->threads <= 1)
+  {
+    for (int i = 0; i < jobs; i++)
+      fn(arg, i);
+    return;
+  }
+
+  mutex_lock(&pl->mutex);
+  pl->fn = fn;
+  pl->arg = arg;
+  pl->jobs = jobs;
+  pl->next = 0;
+  pl->done = 0;
+  pl->gen++;
+  cond_broadcast(&pl->cond_work);
+
+  pool_work(pl);
+  while (pl->done < pl->jobs)
+    cond_wait(&pl->cond_done, &pl->mutex);
+  mutex_unlock(&pl->mutex);
+}
+
+void pool_stop(void)
+{
+  POOL *pl = &gw.pool;
+  if (!pl->started)
+    return;
+
+  mutex_lock(&pl->mutex);
+  pl->quit = 1;
+  cond_broadcast(&pl->cond_work);
+  mutex_unlock(&pl->mutex);
+
+  for (int i = 0; i < pl->threads - 1; i++)
+  {
+#ifdef _WIN32
+    WaitForSingleObject(pl->th[i], INFINITE);
+    CloseHandle(pl->th[i]);
+#else
+    pthread_join(pl->th[i], NULL);
+#endif
+  }
+  pl->started = 0;
+  pl->quit = 0;
+}
+
+// ----------------------------------------
+// course storage
+
+static void arena_reserve(ARENA *a, size_t size)
+{
+  a->used = 0;
+  if (size <= a->cap)
+    return;
+
+  // contents are rebuilt by the caller, no need to copy
+  free(a->buf);
+  a->buf = malloc(size);
+  if (a->buf == NULL)
+    error_exit("Cannot allocate course memory");
+  a->cap = size;
+}
+
+// aligns the address, not the offset. malloc() gives only 16 bytes, so the
+// callers reserve ARENA_ALIGN bytes of slack per array
+static void *arena_alloc(ARENA *a, size_t size)
+{
+  uintptr_t p = (uintptr_t)(a->buf + a->used);
+  size_t ofs = a->used + (size_t)((ARENA_ALIGN - p % ARENA_ALIGN) % ARENA_ALIGN);
+  if (ofs + size > a->cap)
+    error_exit("Course arena overflow");
+  a->used = ofs + size;
+  return a->buf + ofs;
+}
+
+// room for len source segments. grows only, doubling
+void alloc_segdata_src(int len)
+{
+  gw.segdata_src_len = len;
+  if (len <= gw.segdata_src_cap)
+    return;
+
+  int cap = (len > gw.segdata_src_cap * 2) ? len : gw.segdata_src_cap * 2;
+  SEGSRC *p = realloc(gw.segdata_src, sizeof(SEGSRC) * cap);
+  if (p == NULL)
+    error_exit("Cannot allocate course source");
+  gw.segdata_src = p;
+  gw.segdata_src_cap = cap;
+}
+
+// hot and cold arrays for n segments plus the mirrored tail.
+// the arena is kept between stages, it grows only for a longer course
+void alloc_segdata(int n)
+{
+  size_t len = (size_t)n + SEG_PAD;
+  size_t per_seg = 3 * sizeof(float) + 4 * sizeof(double) + sizeof(float) + sizeof(int) // hot
+                   + sizeof(SPRTYPE) + 2 * sizeof(float) + sizeof(int);                 // cold
+  if (len > (SIZE_MAX - 15 * ARENA_ALIGN) / per_seg)
+    error_exit("Course is too long");
+
+  arena_reserve(&gw.course, len * per_seg + 15 * ARENA_ALIGN);
+
+  SEGHOT *hot = &gw.seg;
+  hot->z = arena_alloc(&gw.course, len * sizeof(float));
+  hot->curve = arena_alloc(&gw.course, len * sizeof(float));
+  hot->pitch = arena_alloc(&gw.course, len * sizeof(float));
+  hot->curve_s1 = arena_alloc(&gw.course, len * sizeof(double));
+  hot->curve_s2 = arena_alloc(&gw.course, len * sizeof(double));
+  hot->pitch_s1 = arena_alloc(&gw.course, len * sizeof(double));
+  hot->pitch_s2 = arena_alloc(&gw.course, len * sizeof(double));
+  hot->attr = arena_alloc(&gw.course, len * sizeof(float));
+  hot->deli = arena_alloc(&gw.course, len * sizeof(int));
+
+  SEGCOLD *cold = &gw.segc;
+  cold->sprkind = arena_alloc(&gw.course, len * sizeof(SPRTYPE));
+  cold->sprx = arena_alloc(&gw.course, len * sizeof(float));
+  cold->sprscale = arena_alloc(&gw.course, len * sizeof(float));
+  cold->cars = arena_alloc(&gw.course, len * sizeof(int));
+}
+
+void free_course(void)
+{
+  if (gw.course_map != NULL)
+  {
+    unmap_file(gw.course_map, gw.course_map_size);
+    gw.course_map = NULL;
+    gw.course_map_size = 0;
+  }
+
+  free(gw.course.buf);
+  gw.course.buf = NULL;
+  gw.course.cap = 0;
+  gw.course.used = 0;
+
+  free(gw.segdata_src);
+  gw.segdata_src = NULL;
+  gw.segdata_src_cap = 0;
+  gw.segdata_src_len = 0;
+}
+
+// ----------------------------------------
+// course file
+
+static void course_arrays(void *ary[CA_LEN], size_t esize[CA_LEN])
+{
+  ary[CA_Z] = gw.seg.z;
+  ary[CA_CURVE] = gw.seg.curve;
+  ary[CA_PITCH] = gw.seg.pitch;
+  ary[CA_CURVE_S1] = gw.seg.curve_s1;
+  ary[CA_CURVE_S2] = gw.seg.curve_s2;
+  ary[CA_PITCH_S1] = gw.seg.pitch_s1;
+  ary[CA_PITCH_S2] = gw.seg.pitch_s2;
+  ary[CA_ATTR] = gw.seg.attr;
+  ary[CA_DELI] = gw.seg.deli;
+  ary[CA_SPRKIND] = gw.segc.sprkind;
+  ary[CA_SPRX] = gw.segc.sprx;
+  ary[CA_SPRSCALE] = gw.segc.sprscale;
+
+  for (int k = 0; k < CA_LEN; k++)
+    esize[k] = sizeof(float);
+  esize[CA_CURVE_S1] = esize[CA_CURVE_S2] = sizeof(double);
+  esize[CA_PITCH_S1] = esize[CA_PITCH_S2] = sizeof(double);
+  esize[CA_DELI] = sizeof(int);
+  esize[CA_SPRKIND] = sizeof(SPRTYPE);
+}
+
+// write the current course. loop course only. 0 : ok
+int save_course(const char *filename)
+{
+  void *ary[CA_LEN];
+  size_t esize[CA_LEN];
+  course_arrays(ary, esize);
+
+  size_t len = (size_t)gw.seg_max + SEG_PAD;
+  COURSEHDR hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, COURSE_MAGIC, sizeof(hdr.magic));
+  hdr.endian = COURSE_ENDIAN;
+  hdr.version = COURSE_VERSION;
+  hdr.seg_max = (uint32_t)gw.seg_max;
+  hdr.seg_pad = SEG_PAD;
+  hdr.stage = gw.stage_num;
+  hdr.spr_len = SPR_TBL_LEN;
+  hdr.spr_layout = SPRATLAS_LAYOUT;
+  hdr.seg_length = gw.seg_length;
+  hdr.curve_s1_total = gw.curve_s1_total;
+  hdr.curve_s2_total = gw.curve_s2_total;
+  hdr.pitch_s1_total = gw.pitch_s1_total;
+  hdr.pitch_s2_total = gw.pitch_s2_total;
+
+  uint64_t ofs = sizeof(hdr);
+  for (int k = 0; k < CA_LEN; k++)
+  {
+    ofs = (ofs + (ARENA_ALIGN - 1)) & ~(uint64_t)(ARENA_ALIGN - 1);
+    hdr.ofs[k] = ofs;
+    ofs += len * esize[k];
+  }
+  hdr.size = ofs;
+
+  FILE *fp = fopen(filename, "wb");
+  if (fp == NULL)
+  {
+    errmsg("Cannot open course file");
+    return -1;
+  }
+
+  static const unsigned char zero[ARENA_ALIGN];
+  int ok = (fwrite(&hdr, sizeof(hdr), 1, fp) == 1);
+  uint64_t pos = sizeof(hdr);
+  for (int k = 0; k < CA_LEN && ok; k++)
+  {
+    size_t pad = (size_t)(hdr.ofs[k] - pos);
+    if (pad > 0)
+      ok = (fwrite(zero, 1, pad, fp) == pad);
+    if (ok)
+      ok = (fwrite(ary[k], esize[k], len, fp) == len);
+    pos = hdr.ofs[k] + len * esize[k];
+  }
+
+  if (fclose(fp) != 0 || !ok)
+  {
+    errmsg("Cannot write course file");
+    return -1;
+  }
+  return 0;
+}
+
+// ----------------------------------------
+// course description text. see courses/sample.txt
+//   stage N
+//   seed N
+//   cnt curve pitch billboard   (one line per source segment)
+
+static void course_text_error(const char *filename, int line, const char *msg)
+{
+  fprintf(stderr, "Error: %s:%d: %s\n", filename, line, msg);
+  exit(EXIT_FAILURE);
+}
+
+// read into gw.segdata_src. sets stage and seed when given
+void load_course_text(const char *filename)
+{
+  FILE *fp = fopen(filename, "r");
+  if (fp == NULL)
+    error_exit("Cannot open course description");
+
+  char buf[256];
+  int line = 0;
+  int n = 0;
+  gw.segdata_src_len = 0;
+
+  while (fgets(buf, sizeof(buf), fp) != NULL)
+  {
+    line++;
+    char *c = strchr(buf, '#');
+    if (c != NULL)
+      *c = '\0';
+
+    char word[32];
+    int cnt, ival;
+    float curve, pitch;
+    if (sscanf(buf, " %31s", word) != 1)
+      continue; // empty line
+
+    if (strcmp(word, "stage") == 0)
+    {
+      if (sscanf(buf, " stage %d", &ival) != 1 || ival < 0 || ival > 3)
+        course_text_error(filename, line, "stage needs 0 - 3");
+      gw.stage_num = ival;
+      continue;
+    }
+
+    if (strcmp(word, "seed") == 0)
+    {
+      unsigned int seed;
+      if (sscanf(buf, " seed %u", &seed) != 1)
+        course_text_error(filename, line, "seed needs a number");
+      gw.seed = seed;
+      continue;
+    }
+
+    if (sscanf(buf, " %d %f %f %31s", &cnt, &curve, &pitch, word) != 4)
+      course_text_error(filename, line, "need cnt curve pitch billboard");
+    if (cnt <= 0)
+      course_text_error(filename, line, "cnt must be 1 or more");
+
+    int k;
+    for (k = 0; k < BB_KIND_LEN; k++)
+      if (strcmp(word, bb_name[k]) == 0)
+        break;
+    if (k >= BB_KIND_LEN)
+      course_text_error(filename, line, "unknown billboard type");
+
+    alloc_segdata_src(n + 1);
+    gw.segdata_src[n].cnt = cnt;
+    gw.segdata_src[n].curve = curve;
+    gw.segdata_src[n].pitch = pitch;
+    gw.segdata_src[n].bb = k;
+    n++;
+  }
+  fclose(fp);
+
+  if (n == 0)
+    course_text_error(filename, line, "no segments");
+}
+
+// text course description -> expanded course file.
+// billboards are placed here once, the game only maps the result
+void compile_course(void)
+{
+  load_course_text(gw.course_src_file);
+
+  gw.course_num = 0;
+  new_course_seed();
+  build_course();
+
+  int ret = save_course(gw.course_save_file);
+  free_course();
+  pool_stop();
+  if (ret != 0)
+    exit(EXIT_FAILURE);
+}
+
+// read-only mapping of a whole file. NULL if missing or empty
+static void *map_file(const char *filename, size_t *size)
+{
+  void *p = NULL;
+#ifdef _WIN32
+  HANDLE fh = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (fh == INVALID_HANDLE_VALUE)
+    return NULL;
+  LARGE_INTEGER fsize;
+  if (GetFileSizeEx(fh, &fsize) && fsize.QuadPart > 0)
+  {
+    HANDLE mh = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mh != NULL)
+    {
+      p = MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+      CloseHandle(mh);
+      *size = (size_t)fsize.QuadPart;
+    }
+  }
+  CloseHandle(fh);
+#else
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+  {
+    p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED)
+      p = NULL;
+    *size = (size_t)st.st_size;
+  }
+  close(fd);
+#endif
+  return p;
+}
+
+static void unmap_file(void *p, size_t size)
+{
+#ifdef _WIN32
+  UnmapViewOfFile(p);
+#else
+  munmap(p, size);
+#endif
+}
+
+// map a course file and use it in place. the mapping is kept for
+// stage restarts, only the car draw flags are reset
+void load_course(const char *filename)
+{
+  if (gw.course_map == NULL)
+  {
+    gw.course_map = map_file(filename, &gw.course_map_size);
+    if (gw.course_map == NULL)
+      error_exit("Cannot open course file");
+  }
+
+  const unsigned char *base = gw.course_map;
+  const COURSEHDR *hdr = gw.course_map;
+  if (gw.course_map_size < sizeof(COURSEHDR) || memcmp(hdr->magic, COURSE_MAGIC, sizeof(hdr->magic)) != 0)
+    error_exit("Not a course file");
+  if (hdr->endian != COURSE_ENDIAN)
+    error_exit("Course file has a different byte order");
+  if (hdr->version != COURSE_VERSION)
+    error_exit("Unsupported course file version");
+  if (hdr->seg_pad != SEG_PAD || hdr->seg_length != gw.seg_length)
+    error_exit("Course file was saved with other segment settings");
+  if (hdr->spr_len != SPR_TBL_LEN || hdr->spr_layout != SPRATLAS_LAYOUT)
+    error_exit("Course file was saved with another sprite table. Compile it again");
+  if (hdr->seg_max == 0 || hdr->seg_max > (uint32_t)(INT_MAX - SEG_PAD) || hdr->size > gw.course_map_size || hdr->stage < 0 || hdr->stage > 3)
+    error_exit("Course file is broken");
+
+  void *ary[CA_LEN];
+  size_t esize[CA_LEN];
+  course_arrays(ary, esize);
+
+  uint64_t len = (uint64_t)hdr->seg_max + SEG_PAD;
+  for (int k = 0; k < CA_LEN; k++)
+  {
+    if (hdr->ofs[k] % ARENA_ALIGN != 0 || hdr->ofs[k] > hdr->size || len * esize[k] > hdr->size - hdr->ofs[k])
+      error_exit("Course file is broken");
+  }
+
+  gw.seg.z = (float *)(base + hdr->ofs[CA_Z]);
+  gw.seg.curve = (float *)(base + hdr->ofs[CA_CURVE]);
+  gw.seg.pitch = (float *)(base + hdr->ofs[CA_PITCH]);
+  gw.seg.curve_s1 = (double *)(base + hdr->ofs[CA_CURVE_S1]);
+  gw.seg.curve_s2 = (double *)(base + hdr->ofs[CA_CURVE_S2]);
+  gw.seg.pitch_s1 = (double *)(base + hdr->ofs[CA_PITCH_S1]);
+  gw.seg.pitch_s2 = (double *)(base + hdr->ofs[CA_PITCH_S2]);
+  gw.seg.attr = (float *)(base + hdr->ofs[CA_ATTR]);
+  gw.seg.deli = (int *)(base + hdr->ofs[CA_DELI]);
+  gw.segc.sprkind = (SPRTYPE *)(base + hdr->ofs[CA_SPRKIND]);
+  gw.segc.sprx = (float *)(base + hdr->ofs[CA_SPRX]);
+  gw.segc.sprscale = (float *)(base + hdr->ofs[CA_SPRSCALE]);
+
+  gw.seg_max = (int)hdr->seg_max;
+  gw.seg_total_length = gw.seg_length * gw.seg_max;
+  gw.curve_s1_total = hdr->curve_s1_total;
+  gw.curve_s2_total = hdr->curve_s2_total;
+  gw.pitch_s1_total = hdr->pitch_s1_total;
+  gw.pitch_s2_total = hdr->pitch_s2_total;
+
+  // sprites in the file belong to its stage
+  gw.stage_num = hdr->stage;
+  gw.stage_fix = hdr->stage;
+
+  // car draw flags are written every frame. keep them in the arena
+  arena_reserve(&gw.course, (size_t)len * sizeof(int) + ARENA_ALIGN);
+  gw.segc.cars = arena_alloc(&gw.course, (size_t)len * sizeof(int));
+  memset(gw.segc.cars, 0, (size_t)len * sizeof(int));
+}
+
+// ----------------------------------------
+// billboard born percent table
+typedef struct
+{
+  int per;
+  BBTYPE kind;
+  int min;
+  int rnd;
+} BillboardBornTbl;
+
+#define BB_SET_TBL_LEN 6
+
+static BillboardBornTbl bb_set_tbl[BB_SET_TBL_LEN] = {
+    // per, kind, min, rnd
+    {10, BB_NONE, 10, 30},
+    {50, BB_TREE, 10, 120},
+    {60, BB_GRASS, 10, 100},
+    {80, BB_HOUSE, 20, 40},
+    {90, BB_SLOPEL, 20, 40},
+    {100, BB_SLOPER, 20, 40},
+};
+
+static uint64_t mix64(uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+static void rng_key(RNG *r, unsigned int seed, RNGUSE use, uint64_t index)
+{
+  r->key = mix64(mix64(((uint64_t)seed << 32) | (uint32_t)use) + index) | 1;
+  r->ctr = 0;
+}
+
+// squares: a counter-based RNG (Widynski 2020). four rounds, 32 bits
+static uint32_t squares32(uint64_t ctr, uint64_t key)
+{
+  uint64_t x, y, z;
+  y = x = ctr * key;
+  z = y + key;
+  x = x * x + y;
+  x = (x >> 32) | (x << 32);
+  x = x * x + z;
+  x = (x >> 32) | (x << 32);
+  x = x * x + y;
+  x = (x >> 32) | (x << 32);
+  return (uint32_t)((x * x + z) >> 32);
+}
+
+// 0 .. 0x7fffffff, use like rand()
+static int rng_next(RNG *r)
+{
+  return (int)(squares32(r->ctr++, r->key) >> 1);
+}
+
+// one random source segment. arrow = 0 : no arrow sign before a sharp curve.
+// rng is keyed by the source index
+static void gen_segsrc_random(CGEN *g, SEGSRC *segp, int arrow, RNG *rng)
+{
+  if (g->next_cnt > 0)
+  {
+    segp->cnt = g->next_cnt;
+    segp->curve = g->next_curve;
+    segp->pitch = g->next_pitch;
+    segp->bb = g->next_bb;
+
+    g->next_cnt = 0;
+    g->next_curve = 0.0;
+    g->next_pitch = 0.0;
+    g->next_bb = BB_NONE;
+    return;
+  }
+
+  // get curve and pitch
+  float curve, pitch;
+  int r;
+  curve = 0.0;
+  pitch = 0.0;
+  r = rng_next(rng) % 100;
+  if (r <= 60)
+  {
+    curve = (float)(rng_next(rng) % 300) * 0.01;
+    if (r >= 30)
+      curve *= -1.0;
+  }
+
+  r = rng_next(rng) % 100;
+  if (r <= 60)
+  {
+    pitch = (float)(rng_next(rng) % 40) * 0.01;
+    if (r >= 30)
+      pitch *= -1.0;
+  }
+
+  // get billboard type and segment counter
+  int count = 10;
+  BBTYPE bbkind = BB_NONE;
+  r = rng_next(rng) % 100;
+  for (int ti = 0; ti < BB_SET_TBL_LEN; ti++)
+  {
+    if (r <= bb_set_tbl[ti].per)
+    {
+      bbkind = bb_set_tbl[ti].kind;
+      count = bb_set_tbl[ti].min + (rng_next(rng) % bb_set_tbl[ti].rnd);
+      break;
+    }
+  }
+
+  if (bbkind == BB_SLOPEL || bbkind == BB_SLOPER)
+  {
+    if (curve < -2.0 || curve > 2.0)
+      curve *= 0.5;
+    if (pitch < -0.5 || pitch > 0.5)
+      pitch *= 0.5;
+  }
+
+  if (arrow && (curve > 1.0 || curve < -1.0))
+  {
+    // sharp curve. set road sign L or R
+
+    g->next_cnt = count;
+    g->next_curve = curve;
+    g->next_pitch = pitch;
+    g->next_bb = bbkind;
+
+    segp->cnt = 20;
+    segp->curve = 0.0;
+    segp->pitch = 0.0;
+    segp->bb = (curve > 1.0) ? BB_ARROWL : BB_ARROWR;
+    return;
+  }
+
+  segp->cnt = count;
+  segp->curve = curve;
+  segp->pitch = pitch;
+  segp->bb = bbkind;
+}
+
+// start of the course. a straight, then the start beam
+static void gen_segsrc_start(int j, SEGSRC *segp)
+{
+  segp->cnt = (j == 0) ? 25 : 28;
+  segp->curve = 0.0;
+  segp->pitch = 0.0;
+  segp->bb = (j == 0) ? BB_NONE : BB_BEAM;
+}
+
+void init_course_random(void)
+{
+  RNG rng;
+  rng_key(&rng, gw.course_seed, RNG_COURSE, 0);
+  alloc_segdata_src(20 + rng_next(&rng) % 25);
+
+  CGEN g = {0, 0.0, 0.0, BB_NONE};
+  SEGSRC *segp = gw.segdata_src;
+
+  for (int j = 0; j < gw.segdata_src_len; j++, segp++)
+  {
+    if (j <= 1)
+    {
+      gen_segsrc_start(j, segp);
+      continue;
+    }
+
+    if (j >= (gw.segdata_src_len - 1))
+    {
+      segp->cnt = 50;
+      segp->curve = 0.0;
+      segp->pitch = 0.0;
+      segp->bb = BB_TREE;
+      break;
+    }
+
+    rng_key(&rng, gw.course_seed, RNG_SOURCE, j);
+    gen_segsrc_random(&g, segp, (j < (gw.segdata_src_len - 2)), &rng);
+  }
+}
+
+void init_course_debug(void)
+{
+  alloc_segdata_src(SEGSRC_DBG_LEN);
+  for (int i = 0; i < gw.segdata_src_len; i++)
+  {
+    gw.segdata_src[i].cnt = segdata_src_dbg[i].cnt;
+    gw.segdata_src[i].curve = segdata_src_dbg[i].curve;
+    gw.segdata_src[i].pitch = segdata_src_dbg[i].pitch;
+    gw.segdata_src[i].bb = segdata_src_dbg[i].bb;
+  }
+}
+
+// segment j of src into index n. curve and pitch blend into next
+static void expand_seg(const SEGSRC *src, const SEGSRC *next, int j, int n, float z, RNG *rng)
+{
+  SEGHOT *hot = &gw.seg;
+  SEGCOLD *cold = &gw.segc;
+  float curve, pitch, next_curve, next_pitch;
+  float ratio, c, p, sprx, sprscale;
+  SPRTYPE sprkind;
+
+  curve = src->curve;
+  pitch = -src->pitch;
+  next_curve = next->curve;
+  next_pitch = -next->pitch;
+
+  sprkind = SPR_NONE;
+  sprx = 0.0;
+  sprscale = 1.0;
+
+  ratio = (float)j / (float)src->cnt;
+  c = curve + ((next_curve - curve) * ratio);
+  p = pitch + ((next_pitch - pitch) * ratio);
+
+  set_billboard(src->bb, j, rng, &sprkind, &sprx, &sprscale);
+
+  hot->z[n] = z;
+  hot->curve[n] = c;
+  hot->pitch[n] = p;
+  cold->sprkind[n] = sprkind;
+  cold->sprx[n] = sprx;
+  cold->sprscale[n] = sprscale;
+  cold->cars[n] = 0;
+}
+
+// delineator type of segment i in a lap of lap_len segments
+static int seg_deli(long long i, long long lap_len)
+{
+  if (i < (lap_len * 3 / 4))
+    return (i % 30 == 0) ? 1 : 0;
+  return (i % 20 == 0) ? 2 : 0;
+}
+
+typedef struct expjob
+{
+  const int *ofs; // first segment of each source
+  int jobs;
+} EXPJOB;
+
+// expand one slice of the sources. slices write disjoint segments
+static void expand_job(void *arg, int job)
+{
+  EXPJOB *ej = arg;
+  SEGHOT *hot = &gw.seg;
+  int len = gw.segdata_src_len;
+  int i0 = (int)((long long)len * job / ej->jobs);
+  int i1 = (int)((long long)len * (job + 1) / ej->jobs);
+
+  for (int i = i0; i < i1; i++)
+  {
+    int i2 = (i + 1 < len) ? i + 1 : 0;
+    int n = ej->ofs[i];
+    RNG rng;
+    rng_key(&rng, gw.course_seed, RNG_BILLBOARD, i);
+    for (int j = 0; j < gw.segdata_src[i].cnt; j++, n++)
+    {
+      expand_seg(&gw.segdata_src[i], &gw.segdata_src[i2], j, n, gw.seg_length * n, &rng);
+
+      // road texture line and delineators. fixed to the segment index
+      hot->attr[n] = (float)((16 - 1) - (n % 16));
+      hot->deli[n] = seg_deli(n, gw.seg_max);
+    }
+  }
+}
+
+// sources are independent once their first segment is known.
+// same result for any thread count
+void expand_segdata(void)
+{
+  SEGHOT *hot = &gw.seg;
+  SEGCOLD *cold = &gw.segc;
+  int len = gw.segdata_src_len;
+
+  int *ofs = malloc(sizeof(int) * len);
+  if (ofs == NULL)
+    error_exit("Cannot allocate course offsets");
+  int n = 0;
+  for (int i = 0; i < len; i++)
+  {
+    ofs[i] = n;
+    n += gw.segdata_src[i].cnt;
+  }
+
+  EXPJOB ej;
+  ej.ofs = ofs;
+  ej.jobs = (len < 256) ? len : 256;
+  pool_run(expand_job, &ej, ej.jobs);
+  free(ofs);
+
+  float z = gw.seg_length * n;
+
+  // mirror the start of the course after the end
+  for (int i = n; i < n + SEG_PAD; i++)
+  {
+    hot->z[i] = z;
+    hot->curve[i] = hot->curve[i - n];
+    hot->pitch[i] = hot->pitch[i - n];
+    cold->sprkind[i] = cold->sprkind[i - n];
+    cold->sprx[i] = cold->sprx[i - n];
+    cold->sprscale[i] = cold->sprscale[i - n];
+    cold->cars[i] = 0;
+    z += gw.seg_length;
+  }
+
+  // prefix sums of curve and pitch. see seg_bend()
+  // the mirrored tail continues the sums into the next lap
+  double c1 = 0.0, c2 = 0.0, p1 = 0.0, p2 = 0.0;
+  for (int i = 0; i < n + SEG_PAD; i++)
+  {
+    if (i == n)
+    {
+      gw.curve_s1_total = c1;
+      gw.curve_s2_total = c2;
+      gw.pitch_s1_total = p1;
+      gw.pitch_s2_total = p2;
+    }
+    hot->curve_s1[i] = c1;
+    hot->curve_s2[i] = c2;
+    hot->pitch_s1[i] = p1;
+    hot->pitch_s2[i] = p2;
+    c2 += c1;
+    p2 += p1;
+    c1 += hot->curve[i];
+    p1 += hot->pitch[i];
+  }
+
+  for (int i = n; i < n + SEG_PAD; i++)
+  {
+    hot->attr[i] = hot->attr[i - n];
+    hot->deli[i] = hot->deli[i - n];
+  }
+}
+
+// ----------------------------------------
+// streaming course.
+// The course never loops. Segments are expanded a chunk at a time ahead of
+// the camera, and the chunk behind the camera is dropped by moving the
+// buffer down. camera_z and car z move with it, so they stay small.
+
+// next source segment. a lap line beam at the first source boundary
+// STREAM_LAP or more segments after the last one, but never between an
+// arrow sign and its curve. sources are not cut
+static void stream_next_src(SEGSRC *segp)
+{
+  STREAM *st = &gw.stream;
+
+  if (st->src_cnt <= 1)
+  {
+    gen_segsrc_start(st->src_cnt, segp);
+  }
+  else if (st->src_seg >= st->lap_due && st->gen.next_cnt == 0)
+  {
+    gen_segsrc_start(1, segp);
+    st->lap_next = st->src_seg;
+    st->lap_due = st->src_seg + STREAM_LAP;
+  }
+  else
+  {
+    RNG rng;
+    rng_key(&rng, gw.course_seed, RNG_SOURCE, st->src_cnt);
+    gen_segsrc_random(&st->gen, segp, 1, &rng);
+  }
+
+  st->src_cnt++;
+  st->src_seg += segp->cnt;
+}
+
+// expand segments up to the end of the buffer
+static void stream_fill(void)
+{
+  STREAM *st = &gw.stream;
+  SEGHOT *hot = &gw.seg;
+
+  for (int n = st->fill; n < STREAM_BUF_LEN; n++)
+  {
+    if (st->cur_j >= st->cur.cnt)
+    {
+      st->cur = st->next;
+      stream_next_src(&st->next);
+      st->cur_j = 0;
+      st->cur_idx++;
+      rng_key(&st->rng, gw.course_seed, RNG_BILLBOARD, st->cur_idx);
+    }
+
+    expand_seg(&st->cur, &st->next, st->cur_j, n, gw.seg_length * n, &st->rng);
+    st->cur_j++;
+
+    long long g = st->base + n;
+    hot->attr[n] = (float)((16 - 1) - (g % 16));
+    hot->deli[n] = seg_deli(g % STREAM_LAP, STREAM_LAP);
+
+    // prefix sums, continued from the segment before
+    if (n == 0)
+    {
+      hot->curve_s1[n] = 0.0;
+      hot->curve_s2[n] = 0.0;
+      hot->pitch_s1[n] = 0.0;
+      hot->pitch_s2[n] = 0.0;
+    }
+    else
+    {
+      hot->curve_s1[n] = hot->curve_s1[n - 1] + hot->curve[n - 1];
+      hot->curve_s2[n] = hot->curve_s2[n - 1] + hot->curve_s1[n - 1];
+      hot->pitch_s1[n] = hot->pitch_s1[n - 1] + hot->pitch[n - 1];
+      hot->pitch_s2[n] = hot->pitch_s2[n - 1] + hot->pitch_s1[n - 1];
+    }
+  }
+  st->fill = STREAM_BUF_LEN;
+}
+
+// drop the first chunk. everything moves down by STREAM_CHUNK segments
+static void stream_retire(void)
+{
+  STREAM *st = &gw.stream;
+  SEGHOT *hot = &gw.seg;
+  SEGCOLD *cold = &gw.segc;
+  int c = STREAM_CHUNK;
+  int len = st->fill - c;
+  float dz = gw.seg_length * c;
+
+  memmove(hot->curve, hot->curve + c, sizeof(float) * len);
+  memmove(hot->pitch, hot->pitch + c, sizeof(float) * len);
+  memmove(hot->attr, hot->attr + c, sizeof(float) * len);
+  memmove(hot->deli, hot->deli + c, sizeof(int) * len);
+  memmove(cold->sprkind, cold->sprkind + c, sizeof(SPRTYPE) * len);
+  memmove(cold->sprx, cold->sprx + c, sizeof(float) * len);
+  memmove(cold->sprscale, cold->sprscale + c, sizeof(float) * len);
+  memmove(cold->cars, cold->cars + c, sizeof(int) * len);
+
+  // prefix sums restart from the new index 0. only differences are used
+  double c1 = hot->curve_s1[c], c2 = hot->curve_s2[c];
+  double p1 = hot->pitch_s1[c], p2 = hot->pitch_s2[c];
+  for (int i = 0; i < len; i++)
+  {
+    hot->z[i] = gw.seg_length * i;
+    hot->curve_s1[i] = hot->curve_s1[i + c] - c1;
+    hot->curve_s2[i] = hot->curve_s2[i + c] - c2 - i * c1;
+    hot->pitch_s1[i] = hot->pitch_s1[i + c] - p1;
+    hot->pitch_s2[i] = hot->pitch_s2[i + c] - p2 - i * p1;
+  }
+
+  st->base += c;
+  st->fill = len;
+  gw.camera_z -= dz;
+  gw.prev_camera_z -= dz;
+  for (int i = 0; i < gw.cars_len; i++)
+    gw.cars[i].z -= dz;
+}
+
+void init_stream(void)
+{
+  STREAM *st = &gw.stream;
+
+  gw.seg_max = STREAM_BUF_LEN;
+  gw.seg_total_length = gw.seg_length * gw.seg_max;
+  alloc_segdata(gw.seg_max);
+
+  st->base = 0;
+  st->fill = 0;
+  st->src_cnt = 0;
+  st->src_seg = 0;
+  st->lap_due = STREAM_LAP;
+  st->lap_next = LLONG_MAX;
+  st->gen = (CGEN){0, 0.0, 0.0, BB_NONE};
+  new_course_seed();
+  stream_next_src(&st->cur);
+  stream_next_src(&st->next);
+  st->cur_j = 0;
+  st->cur_idx = 0;
+  rng_key(&st->rng, gw.course_seed, RNG_BILLBOARD, 0);
+
+  stream_fill();
+}
+
+// after the camera moved. drop chunks behind, fill ahead, count laps
+void update_stream(void)
+{
+  STREAM *st = &gw.stream;
+
+  int idx = (int)(gw.camera_z / gw.seg_length);
+  while (idx >= STREAM_CHUNK)
+  {
+    stream_retire();
+    idx -= STREAM_CHUNK;
+  }
+  stream_fill();
+
+  // the beam of the next lap is generated less than a lap ahead
+  if (st->base + idx >= st->lap_next)
+  {
+    st->lap_next = LLONG_MAX;
+    gw.laps++;
+    gw.laps_total++;
+  }
+}
+
+// prefix sums at index n. n can go past the end, the course loops
+static void seg_prefix(int n, double *c1, double *c2, double *p1, double *p2)
+{
+  int q = n / gw.seg_max;
+  int r = n % gw.seg_max;
+  SEGHOT *hot = &gw.seg;
+
+  // q whole laps before r
+  double laps2 = (double)gw.seg_max * q * (q - 1) / 2.0 + (double)q * r;
+  *c1 = hot->curve_s1[r] + q * gw.curve_s1_total;
+  *c2 = hot->curve_s2[r] + q * gw.curve_s2_total + laps2 * gw.curve_s1_total;
+  *p1 = hot->pitch_s1[r] + q * gw.pitch_s1_total;
+  *p2 = hot->pitch_s2[r] + q * gw.pitch_s2_total + laps2 * gw.pitch_s1_total;
+}
+
+// x, y bend of segment idx + k relative to segment idx.
+// same result as walking k segments from idx with
+//   x += xd; xd += curve;  (xd, x start at 0. y and pitch likewise)
+// but O(1), no walk.
+void seg_bend(int idx, int k, float *bx, float *by)
+{
+  double c1, c2, p1, p2, c1k, c2k, p1k, p2k;
+  seg_prefix(idx, &c1, &c2, &p1, &p2);
+  seg_prefix(idx + k, &c1k, &c2k, &p1k, &p2k);
+  *bx = (float)(c2k - c2 - k * c1);
+  *by = (float)(p2k - p2 - k * p1);
+}
+
+// ----------------------------------------
+// Road projection kernel.
+// Camera relative x, y, z of VIEW_DIST segments, with attr and delineator
+// copied from the course. proj_scalar() is the reference. The SIMD kernels
+// do the same operations in the same order, so the output is bit exact.
+
+// segments k .. pk->k1 - 1
+static void proj_scalar_range(const PROJK *pk, DT *o, int k)
+{
+  SEGHOT *hot = &gw.seg;
+  for (; k < pk->k1; k++)
+  {
+    int r = pk->r0 + (k - pk->k0);
+    float kf = (float)k;
+    float bx = (float)(hot->curve_s2[r] + (pk->cc + pk->cl * k));
+    float by = (float)(hot->pitch_s2[r] + (pk->pc + pk->pl * k));
+    o->x[k] = ((pk->cx + pk->xd * kf) + bx) + pk->ofsx;
+    o->y[k] = ((pk->cy + pk->yd * kf) + by) + pk->ofsy;
+    o->z[k] = pk->cz + pk->zd * kf;
+    o->attr[k] = hot->attr[r];
+    o->deli[k] = hot->deli[r];
+    o->idx[k] = r;
+  }
+}
+
+static void proj_scalar(const PROJK *pk, DT *o)
+{
+  proj_scalar_range(pk, o, pk->k0);
+}
+
+#ifdef USE_SIMD
+// 8 segments per step, two 4 lane halves
+__attribute__((target("sse2"))) static void proj_sse2(const PROJK *pk, DT *o)
+{
+  SEGHOT *hot = &gw.seg;
+  int k = pk->k0;
+  __m128d cc = _mm_set1_pd(pk->cc), cl = _mm_set1_pd(pk->cl);
+  __m128d pc = _mm_set1_pd(pk->pc), pl = _mm_set1_pd(pk->pl);
+  __m128 cx = _mm_set1_ps(pk->cx), xd = _mm_set1_ps(pk->xd);
+  __m128 cy = _mm_set1_ps(pk->cy), yd = _mm_set1_ps(pk->yd);
+  __m128 cz = _mm_set1_ps(pk->cz), zd = _mm_set1_ps(pk->zd);
+  __m128 ofsx = _mm_set1_ps(pk->ofsx), ofsy = _mm_set1_ps(pk->ofsy);
+  __m128i lane = _mm_set_epi32(3, 2, 1, 0);
+
+  for (; k + 8 <= pk->k1; k += 8)
+  {
+    for (int h = 0; h < 8; h += 4)
+    {
+      int kk = k + h;
+      int r = pk->r0 + (kk - pk->k0);
+      __m128d kd0 = _mm_set_pd(kk + 1, kk);
+      __m128d kd1 = _mm_set_pd(kk + 3, kk + 2);
+
+      // bend. double, then to float
+      __m128d s0 = _mm_loadu_pd(&hot->curve_s2[r]);
+      __m128d s1 = _mm_loadu_pd(&hot->curve_s2[r + 2]);
+      __m128 bx = _mm_movelh_ps(_mm_cvtpd_ps(_mm_add_pd(s0, _mm_add_pd(cc, _mm_mul_pd(cl, kd0)))),
+                                _mm_cvtpd_ps(_mm_add_pd(s1, _mm_add_pd(cc, _mm_mul_pd(cl, kd1)))));
+      s0 = _mm_loadu_pd(&hot->pitch_s2[r]);
+      s1 = _mm_loadu_pd(&hot->pitch_s2[r + 2]);
+      __m128 by = _mm_movelh_ps(_mm_cvtpd_ps(_mm_add_pd(s0, _mm_add_pd(pc, _mm_mul_pd(pl, kd0)))),
+                                _mm_cvtpd_ps(_mm_add_pd(s1, _mm_add_pd(pc, _mm_mul_pd(pl, kd1)))));
+
+      __m128 kf = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(kk), lane));
+      _mm_storeu_ps(&o->x[kk], _mm_add_ps(_mm_add_ps(_mm_add_ps(cx, _mm_mul_ps(xd, kf)), bx), ofsx));
+      _mm_storeu_ps(&o->y[kk], _mm_add_ps(_mm_add_ps(_mm_add_ps(cy, _mm_mul_ps(yd, kf)), by), ofsy));
+      _mm_storeu_ps(&o->z[kk], _mm_add_ps(cz, _mm_mul_ps(zd, kf)));
+
+      // attr and delineator
+      _mm_storeu_ps(&o->attr[kk], _mm_loadu_ps(&hot->attr[r]));
+      _mm_storeu_si128((__m128i *)&o->deli[kk], _mm_loadu_si128((__m128i *)&hot->deli[r]));
+      _mm_storeu_si128((__m128i *)&o->idx[kk], _mm_add_epi32(_mm_set1_epi32(r), lane));
+    }
+  }
+
+  proj_scalar_range(pk, o, k);
+}
+
+// 8 segments per step
+__attribute__((target("avx2"))) static void proj_avx2(const PROJK *pk, DT *o)
+{
+  SEGHOT *hot = &gw.seg;
+  int k = pk->k0;
+  __m256d cc = _mm256_set1_pd(pk->cc), cl = _mm256_set1_pd(pk->cl);
+  __m256d pc = _mm256_set1_pd(pk->pc), pl = _mm256_set1_pd(pk->pl);
+  __m256 cx = _mm256_set1_ps(pk->cx), xd = _mm256_set1_ps(pk->xd);
+  __m256 cy = _mm256_set1_ps(pk->cy), yd = _mm256_set1_ps(pk->yd);
+  __m256 cz = _mm256_set1_ps(pk->cz), zd = _mm256_set1_ps(pk->zd);
+  __m256 ofsx = _mm256_set1_ps(pk->ofsx), ofsy = _mm256_set1_ps(pk->ofsy);
+  __m256i lane = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+
+  for (; k + 8 <= pk->k1; k += 8)
+  {
+    int r = pk->r0 + (k - pk->k0);
+    __m256d kd0 = _mm256_set_pd(k + 3, k + 2, k + 1, k);
+    __m256d kd1 = _mm256_set_pd(k + 7, k + 6, k + 5, k + 4);
+
+    // bend. double, then to float
+    __m256d s0 = _mm256_loadu_pd(&hot->curve_s2[r]);
+    __m256d s1 = _mm256_loadu_pd(&hot->curve_s2[r + 4]);
+    __m256 bx = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(_mm256_add_pd(s0, _mm256_add_pd(cc, _mm256_mul_pd(cl, kd0))))),
+                                     _mm256_cvtpd_ps(_mm256_add_pd(s1, _mm256_add_pd(cc, _mm256_mul_pd(cl, kd1)))), 1);
+    s0 = _mm256_loadu_pd(&hot->pitch_s2[r]);
+    s1 = _mm256_loadu_pd(&hot->pitch_s2[r + 4]);
+    __m256 by = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(_mm256_add_pd(s0, _mm256_add_pd(pc, _mm256_mul_pd(pl, kd0))))),
+                                     _mm256_cvtpd_ps(_mm256_add_pd(s1, _mm256_add_pd(pc, _mm256_mul_pd(pl, kd1)))), 1);
+
+    __m256 kf = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(k), lane));
+    _mm256_storeu_ps(&o->x[k], _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(cx, _mm256_mul_ps(xd, kf)), bx), ofsx));
+    _mm256_storeu_ps(&o->y[k], _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(cy, _mm256_mul_ps(yd, kf)), by), ofsy));
+    _mm256_storeu_ps(&o->z[k], _mm256_add_ps(cz, _mm256_mul_ps(zd, kf)));
+
+    // attr and delineator
+    _mm256_storeu_ps(&o->attr[k], _mm256_loadu_ps(&hot->attr[r]));
+    _mm256_storeu_si256((__m256i *)&o->deli[k], _mm256_loadu_si256((__m256i *)&hot->deli[r]));
+    _mm256_storeu_si256((__m256i *)&o->idx[k], _mm256_add_epi32(_mm256_set1_epi32(r), lane));
+  }
+
+  proj_scalar_range(pk, o, k);
+}
+#endif
+
+// kernel of kind. NULL if the CPU does not have it
+static PROJFN proj_kernel(PROJKIND kind)
+{
+#ifdef USE_SIMD
+  __builtin_cpu_init();
+  if (kind == PROJ_SSE2 && __builtin_cpu_supports("sse2"))
+    return proj_sse2;
+  if (kind == PROJ_AVX2 && __builtin_cpu_supports("avx2"))
+    return proj_avx2;
+#endif
+  return (kind == PROJ_SCALAR) ? proj_scalar : NULL;
+}
+
+// pick kernel. PROJ_AUTO takes the best one the CPU has
+void init_proj_kernel(void)
+{
+  PROJKIND kind = gw.proj_kind;
+
+  if (kind != PROJ_AUTO && proj_kernel(kind) == NULL)
+  {
+    errmsg("Projection kernel is not supported on this CPU. Use auto");
+    kind = PROJ_AUTO;
+  }
+  if (kind == PROJ_AUTO)
+  {
+    if (proj_kernel(PROJ_AVX2) != NULL)
+      kind = PROJ_AVX2;
+    else if (proj_kernel(PROJ_SSE2) != NULL)
+      kind = PROJ_SSE2;
+    else
+      kind = PROJ_SCALAR;
+  }
+
+  gw.proj_kind = kind;
+  gw.proj_fn = proj_kernel(kind);
+}
+
+// kernel input for camera z ccz on segment idx
+static void proj_input(PROJK *pk, int idx, float ccz)
+{
+  float z, curve, pitch;
+  z = gw.seg.z[idx];
+  curve = gw.seg.curve[idx];
+  pitch = gw.seg.pitch[idx];
+
+  float camz, xd, yd;
+  camz = (ccz - z) / gw.seg_length;
+  xd = -camz * curve;
+  yd = -camz * pitch;
+
+  pk->cx = -(xd * camz);
+  pk->xd = xd;
+  pk->cy = -(yd * camz);
+  pk->yd = yd;
+  pk->cz = z - ccz;
+  pk->zd = gw.seg_length;
+  pk->ofsx = gw.shift_cam_x;
+  pk->ofsy = gw.road_y;
+}
+
+// project VIEW_DIST segments from idx into gw.dt.
+// idx < seg_max. the padded tail keeps the run contiguous
+void project_road(PROJK *pk, int idx)
+{
+  // bend = s2[idx + k] + (cc + cl * k)
+  pk->cc = -gw.seg.curve_s2[idx];
+  pk->cl = -gw.seg.curve_s1[idx];
+  pk->pc = -gw.seg.pitch_s2[idx];
+  pk->pl = -gw.seg.pitch_s1[idx];
+
+  pk->k0 = 0;
+  pk->r0 = idx;
+  pk->k1 = VIEW_DIST;
+  gw.proj_fn(pk, &gw.dt);
+}
+
+// --proj-check. run each SIMD kernel the CPU has from every segment of
+// the course at a few camera positions and compare the whole output with
+// proj_scalar(). returns the number of runs that differ
+int proj_check(void)
+{
+  static DT ref;
+  static const float camz_tbl[] = {0.0, 0.25, 0.5, 0.999};
+  int camz_len = sizeof(camz_tbl) / sizeof(camz_tbl[0]);
+  int bad = 0;
+
+  init_work();
+  printf("seed %u, %d segments\n", gw.seed, gw.seg_max);
+
+  for (int kind = PROJ_SSE2; kind < PROJ_KIND_LEN; kind++)
+  {
+    PROJFN fn = proj_kernel(kind);
+    if (fn == NULL)
+    {
+      printf("%s : not supported on this CPU, skipped\n", proj_name[kind]);
+      continue;
+    }
+
+    int diff = 0;
+    for (int idx = 0; idx < gw.seg_max; idx++)
+    {
+      for (int j = 0; j < camz_len; j++)
+      {
+        PROJK pk;
+        proj_input(&pk, idx, (idx + camz_tbl[j]) * gw.seg_length);
+
+        gw.proj_fn = proj_scalar;
+        project_road(&pk, idx);
+        ref = gw.dt;
+        gw.proj_fn = fn;
+        project_road(&pk, idx);
+
+        if (memcmp(&ref, &gw.dt, sizeof(DT)) != 0)
+        {
+          if (diff == 0)
+            printf("%s : segment %d camz %.3f differs\n", proj_name[kind], idx, camz_tbl[j]);
+          diff++;
+        }
+      }
+    }
+    printf("%s : %d of %d runs differ\n", proj_name[kind], diff, gw.seg_max * camz_len);
+    bad += diff;
+  }
+
+  gw.proj_fn = proj_kernel(gw.proj_kind);
+  free_course();
+  pool_stop();
+  return bad;
+}
+
+static SPRTYPE house_tbl[4][2][3] = {
+    {
+        // stage 0
+        {SPR_HOUSE0_0L, SPR_HOUSE0_1L, SPR_HOUSE0_2L},
+        {SPR_HOUSE0_0R, SPR_HOUSE0_1R, SPR_HOUSE0_2R},
+    },
+    {
+        // stage 1
+        {SPR_HOUSE0_0L, SPR_HOUSE0_1L, SPR_HOUSE0_2L},
+        {SPR_HOUSE0_0R, SPR_HOUSE0_1R, SPR_HOUSE0_2R},
+    },
+    {
+        // stage 2
+        {SPR_HOUSE2_0L, SPR_HOUSE2_1L, SPR_HOUSE2_2L},
+        {SPR_HOUSE2_0R, SPR_HOUSE2_1R, SPR_HOUSE2_2R},
+    },
+    {
+        // stage 3
+        {SPR_HOUSE3_0L, SPR_HOUSE3_1L, SPR_HOUSE3_2L},
+        {SPR_HOUSE3_0R, SPR_HOUSE3_1R, SPR_HOUSE3_2R},
+    },
+};
+
+void set_billboard(BBTYPE bbkind, int j, RNG *rng, SPRTYPE *spr_kind, float *spr_x, float *spr_scale)
+{
+  *spr_kind = 0;
+  *spr_x = 0.0;
+  *spr_scale = 1.0;
+
+  if (bbkind == BB_NONE)
+    return;
+
+  if (bbkind == BB_TREE && gw.disable_tree != 0)
+    bbkind = BB_GRASS;
+
+  if ((bbkind == BB_SLOPEL || bbkind == BB_SLOPER) && gw.disable_slope != 0)
+    bbkind = BB_GRASS;
+
+  switch (bbkind)
+  {
+  case BB_TREE:
+    *spr_kind = SPR_TREE0_0 + (rng_next(rng) % 4) + (gw.stage_num * 4);
+    *spr_x = (float)(rng_next(rng) % 450) + gw.road_w + 150.0;
+    if (rng_next(rng) % 2 == 0)
+      *spr_x *= -1.0;
+    *spr_scale = (float)(100 + rng_next(rng) % 100) * 0.01;
+    break;
+
+  case BB_ARROWR:
+  case BB_ARROWL:
+    if (j % 4 == 2)
+    {
+      // arrow sign
+      *spr_kind = SPR_ARROWR2L + (bbkind - BB_ARROWR);
+      *spr_x = gw.road_w + 150.0;
+    }
+    else
+    {
+      // grass
+      *spr_kind = SPR_GRASS0 + (gw.stage_num * 1);
+      *spr_x = gw.road_w + 150.0 + (rng_next(rng) % 60) - 30;
+    }
+    if (bbkind == BB_ARROWL)
+      *spr_x *= -1.0;
+    *spr_scale = 1.0;
+    break;
+
+  case BB_GRASS:
+    *spr_kind = SPR_GRASS0 + (gw.stage_num * 1);
+    *spr_x = (rng_next(rng) % 300) + gw.road_w + 250.0;
+    if (rng_next(rng) % 2 == 0)
+      *spr_x *= -1.0;
+    *spr_scale = (float)(50 + rng_next(rng) % 150) * 0.01;
+    break;
+
+  case BB_BEAM:
+    *spr_kind = 0;
+    *spr_x = 0;
+    *spr_scale = 1.0;
+    if (j % 10 == 0)
+      *spr_kind = SPR_BEAM;
+    break;
+
+  case BB_HOUSE:
+    if (j % 12 == 4)
+    {
+      // house
+      *spr_x = -(float)(gw.road_w + 450 + rng_next(rng) % 100);
+      *spr_scale = 1.0;
+      int lr = (rng_next(rng) % 2 == 0) ? 0 : 1;
+      *spr_kind = house_tbl[gw.stage_num][lr][rng_next(rng) % 3];
+      *spr_x *= ((lr == 0) ? 1.0 : -1.0);
+    }
+    else
+    {
+      // tree or none
+      if (j % 2 == 0)
+      {
+        // tree
+        *spr_kind = SPR_TREE0_0 + (rng_next(rng) % 4) + (gw.stage_num * 4);
+        *spr_x = (float)(rng_next(rng) % 500) + gw.road_w + 400.0;
+        if (rng_next(rng) % 2 == 0)
+          *spr_x *= -1.0;
+        *spr_scale = (float)(100 + rng_next(rng) % 100) * 0.01;
+      }
+      else
+      {
+        // none
+        *spr_kind = SPR_NONE;
+      }
+    }
+    break;
+
+  case BB_SLOPEL:
+    *spr_scale = 1.0;
+    if (j == 0)
+    {
+      // trees wall
+      *spr_kind = SPR_WALL0 + (gw.stage_num * 1);
+      *spr_x = -(gw.road_w * 6.0);
+    }
+    else
+    {
+      if (j % 2 == 0)
+      {
+        // slope L
+        *spr_kind = SPR_SLOPE0_L + (gw.stage_num * 2);
+        *spr_x = -(gw.road_w * 1.5);
+      }
+      else
+      {
+        // tree
+        *spr_kind = SPR_TREE0_0 + (rng_next(rng) % 4) + (gw.stage_num * 4);
+        *spr_x = (float)(rng_next(rng) % 600) + gw.road_w + 300.0;
+        *spr_scale = (float)(100 + rng_next(rng) % 100) * 0.01;
+      }
+    }
+    break;
+
+  case BB_SLOPER:
+    *spr_scale = 1.0;
+    if (j == 0)
+    {
+      // trees wall
+      *spr_kind = SPR_WALL0 + (gw.stage_num * 1);
+      *spr_x = (gw.road_w * 6.0);
+    }
+    else
+    {
+      if (j % 2 == 0)
+      {
+        // slope R
+        *spr_kind = SPR_SLOPE0_R + (gw.stage_num * 2);
+        *spr_x = (gw.road_w * 1.5);
+      }
+      else
+      {
+        // tree
+        *spr_kind = SPR_TREE0_0 + (rng_next(rng) % 4) + (gw.stage_num * 4);
+        *spr_x = -((float)(rng_next(rng) % 600) + gw.road_w + 300.0);
+        *spr_scale = (float)(100 + rng_next(rng) % 100) * 0.01;
+      }
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+static char *bgimgs[4] = {
+    BG0_IMG,
+    BG1_IMG,
+    BG2_IMG,
+    BG3_IMG,
+};
+
+// ----------------------------------------
+// image loader.
+// Loader threads decode the image files into memory. The GL thread
+// uploads the pixels: all at once when a frame needs the image
+// (tex_load_need()), or TEX_UPLOAD_ROWS rows per frame in the background
+// (tex_load_poll()). The first frame only waits for the sprites and the
+// background of its stage.
+// Decoded images are kept in a cache file next to the image, with their
+// mipmaps. Later runs map the cache and upload from it, no decode.
+// Only the current stage's background is resident. The next one is
+// requested when the fade-out starts, and the old one released after
+// the switch (tex_load_stage()).
+
+// next power of two
+static int pot(int n)
+{
+  int p = 1;
+  while (p < n)
+    p <<= 1;
+  return p;
+}
+
+// NPOT textures are core since GL 2.0, an extension before that.
+// without them images are padded to power of two sizes.
+// GL_TEXTURE_MAX_LEVEL is core since GL 1.2
+void init_tex_caps(void)
+{
+  int major = 0, minor = 0;
+  const char *ver = (const char *)glGetString(GL_VERSION);
+  if (ver != NULL)
+    sscanf(ver, "%d.%d", &major, &minor);
+
+  // a truncated mipmap chain needs GL_TEXTURE_MAX_LEVEL
+  gw.tex_max_level = (gw.renderer == RENDER_GL33 || major > 1 || (major == 1 && minor >= 2));
+
+  gw.tex_npot = 0;
+  if (gw.no_npot)
+    return;
+  if (gw.renderer == RENDER_GL33 || major >= 2)
+  {
+    gw.tex_npot = 1;
+    return;
+  }
+
+  // whole word in the space separated list
+  const char *name = "GL_ARB_texture_non_power_of_two";
+  size_t len = strlen(name);
+  const char *ext = (const char *)glGetString(GL_EXTENSIONS);
+  for (const char *p = ext; p != NULL && (p = strstr(p, name)) != NULL; p += len)
+  {
+    if ((p == ext || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0'))
+    {
+      gw.tex_npot = 1;
+      return;
+    }
+  }
+}
+
+// texture size for an image size
+static int tex_size(int n)
+{
+  return gw.tex_npot ? n : pot(n);
+}
+
+// pad to dw x dh. columns past the image wrap around it, its first
+// columns then its last ones, so a GL_REPEAT texture drawn up to the
+// image edge has no seam. rows past it repeat the last row.
+// frees src when padded
+static unsigned char *tex_pad(unsigned char *src, int w, int h, int ch, int dw, int dh)
+{
+  if (dw == w && dh == h)
+    return src;
+
+  unsigned char *dst = malloc((size_t)dw * dh * ch);
+  if (dst != NULL)
+  {
+    int head = (dw - w) / 2;
+    int tail = dw - w - head;
+    for (int y = 0; y < dh; y++)
+    {
+      const unsigned char *sp = src + (size_t)((y < h) ? y : h - 1) * w * ch;
+      unsigned char *d = dst + (size_t)y * dw * ch;
+      memcpy(d, sp, (size_t)w * ch);
+      memcpy(d + (size_t)w * ch, sp, (size_t)head * ch);
+      memcpy(d + (size_t)(w + head) * ch, sp + (size_t)(w - tail) * ch, (size_t)tail * ch);
+    }
+  }
+  SOIL_free_image_data(src);
+  return dst;
+}
+
+// mipmap levels the atlas gutter covers. at level l bilinear reaches
+// 2^(l-1) pixels past a cell edge. w, h : atlas size as uploaded
+static int spr_atlas_levels(int w, int h)
+{
+  int gx = SPR_GUTTER * w / SPRATLAS_W;
+  int gy = SPR_GUTTER * h / SPRATLAS_H;
+  int g = (gx < gy) ? gx : gy;
+  int n = 1;
+  while (g >= (1 << (n - 1)))
+    n++;
+  return n;
+}
+
+static int tex_levels(const TEXIMG *im, int w, int h)
+{
+  int n = 1;
+  if (im->mip)
+    while ((w >> (n - 1)) > 1 || (h >> (n - 1)) > 1)
+      n++;
+  // GL 1.1 has no GL_TEXTURE_MAX_LEVEL. upload the whole chain, the
+  // levels below the gutter bleed a little
+  if (im->atlas && gw.tex_max_level && n > spr_atlas_levels(w, h))
+    n = spr_atlas_levels(w, h);
+  return n;
+}
+
+static int tex_level_w(const TEXIMG *im, int l)
+{
+  return (im->w >> l) > 0 ? (im->w >> l) : 1;
+}
+
+static int tex_level_h(const TEXIMG *im, int l)
+{
+  return (im->h >> l) > 0 ? (im->h >> l) : 1;
+}
+
+// level offsets, each aligned like the course arrays. returns total size
+static size_t tex_layout(TEXIMG *im, size_t ofs)
+{
+  for (int l = 0; l < im->levels; l++)
+  {
+    ofs = (ofs + (ARENA_ALIGN - 1)) & ~(size_t)(ARENA_ALIGN - 1);
+    im->lofs[l] = ofs;
+    ofs += (size_t)tex_level_w(im, l) * tex_level_h(im, l) * im->ch;
+  }
+  return ofs;
+}
+
+// 2x2 box filter, level l - 1 into level l
+static void tex_mipmap(TEXIMG *im, int l)
+{
+  int sw = tex_level_w(im, l - 1);
+  int sh = tex_level_h(im, l - 1);
+  int dw = tex_level_w(im, l);
+  int dh = tex_level_h(im, l);
+  int ch = im->ch;
+  const unsigned char *src = im->pix + im->lofs[l - 1];
+  unsigned char *d = im->pix + im->lofs[l];
+
+  for (int y = 0; y < dh; y++)
+  {
+    const unsigned char *r0 = src + (size_t)(y * 2) * sw * ch;
+    const unsigned char *r1 = (y * 2 + 1 < sh) ? r0 + (size_t)sw * ch : r0;
+    for (int x = 0; x < dw; x++)
+    {
+      int x0 = x * 2 * ch;
+      int x1 = (x * 2 + 1 < sw) ? x0 + ch : x0;
+      for (int c = 0; c < ch; c++)
+        *d++ = (unsigned char)((r0[x0 + c] + r0[x1 + c] + r1[x0 + c] + r1[x1 + c] + 2) >> 2);
+    }
+  }
+}
+
+static void tex_free_pix(TEXIMG *im)
+{
+  if (im->pix == NULL)
+    return;
+  if (im->mem == TEXMEM_MAP)
+    unmap_file(im->pix, im->map_size);
+  else if (im->mem == TEXMEM_HEAP)
+    free(im->pix);
+  else
+    SOIL_free_image_data(im->pix);
+  im->pix = NULL;
+}
+
+// map the cache of im. 0 : ok, pixels are in the mapping
+static int tex_cache_load(TEXIMG *im, const char *cache, const struct stat *st)
+{
+  size_t size;
+  unsigned char *base = map_file(cache, &size);
+  if (base == NULL)
+    return -1;
+
+  const TEXCACHEHDR *hdr = (const TEXCACHEHDR *)base;
+  int ok = (size >= sizeof(TEXCACHEHDR) &&
+            memcmp(hdr->magic, TEXCACHE_MAGIC, sizeof(hdr->magic)) == 0 &&
+            hdr->endian == COURSE_ENDIAN &&
+            hdr->version == TEXCACHE_VERSION &&
+            hdr->src_size == (uint64_t)st->st_size &&
+            hdr->src_mtime == (int64_t)st->st_mtime &&
+            hdr->layout == (im->atlas ? SPRATLAS_LAYOUT : 0) &&
+            hdr->size == size &&
+            (hdr->ch == 3 || hdr->ch == 4) &&
+            hdr->iw > 0 && hdr->iw <= 65536 && hdr->w == tex_size(hdr->iw) &&
+            hdr->ih > 0 && hdr->ih <= 65536 && hdr->h == tex_size(hdr->ih));
+  if (ok)
+  {
+    im->w = hdr->w;
+    im->h = hdr->h;
+    im->iw = hdr->iw;
+    im->ih = hdr->ih;
+    im->ch = hdr->ch;
+    im->levels = tex_levels(im, im->w, im->h);
+    ok = (hdr->levels == im->levels && tex_layout(im, sizeof(TEXCACHEHDR)) <= size);
+    for (int l = 0; l < im->levels && ok; l++)
+      ok = (hdr->ofs[l] == im->lofs[l]);
+  }
+  if (!ok)
+  {
+    unmap_file(base, size);
+    return -1;
+  }
+
+  im->pix = base;
+  im->mem = TEXMEM_MAP;
+  im->map_size = size;
+  return 0;
+}
+
+// write the decoded levels of im. written to a temporary file and
+// renamed, so a run killed while writing leaves no broken cache
+static void tex_cache_save(const TEXIMG *im, const char *cache, const struct stat *st)
+{
+  TEXCACHEHDR hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, TEXCACHE_MAGIC, sizeof(hdr.magic));
+  hdr.endian = COURSE_ENDIAN;
+  hdr.version = TEXCACHE_VERSION;
+  hdr.src_size = (uint64_t)st->st_size;
+  hdr.src_mtime = (int64_t)st->st_mtime;
+  hdr.w = im->w;
+  hdr.h = im->h;
+  hdr.iw = im->iw;
+  hdr.ih = im->ih;
+  hdr.ch = im->ch;
+  hdr.levels = im->levels;
+  hdr.layout = im->atlas ? SPRATLAS_LAYOUT : 0;
+
+  // same levels, offsets after the header
+  TEXIMG t = *im;
+  hdr.size = tex_layout(&t, sizeof(hdr));
+  for (int l = 0; l < im->levels; l++)
+    hdr.ofs[l] = t.lofs[l];
+
+  char tmp[FILENAME_MAX + 8];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", cache);
+  FILE *fp = fopen(tmp, "wb");
+  if (fp == NULL)
+    return;
+
+  static const unsigned char zero[ARENA_ALIGN];
+  int ok = (fwrite(&hdr, sizeof(hdr), 1, fp) == 1);
+  size_t pos = sizeof(hdr);
+  for (int l = 0; l < im->levels && ok; l++)
+  {
+    size_t pad = t.lofs[l] - pos;
+    size_t len = (size_t)tex_level_w(im, l) * tex_level_h(im, l) * im->ch;
+    if (pad > 0)
+      ok = (fwrite(zero, 1, pad, fp) == pad);
+    if (ok)
+      ok = (fwrite(im->pix + im->lofs[l], 1, len, fp) == len);
+    pos = t.lofs[l] + len;
+  }
+
+  if (fclose(fp) != 0 || !ok)
+  {
+    remove(tmp);
+    errmsg("Cannot write texture cache");
+    return;
+  }
+#ifdef _WIN32
+  remove(cache);
+#endif
+  if (rename(tmp, cache) != 0)
+    remove(tmp);
+}
+
+// loader thread side. no GL calls here.
+// from the cache when it is fresh, else decode, pad, mipmap, cache
+static void tex_decode(TEXIMG *im)
+{
+  struct stat st;
+  char cache[FILENAME_MAX];
+
+  im->pix = NULL;
+  if (stat(im->file, &st) != 0)
+    return;
+  snprintf(cache, sizeof(cache), "%s%s", im->file, TEXCACHE_EXT);
+  if (tex_cache_load(im, cache, &st) == 0)
+    return;
+
+  int w, h, ch;
+  unsigned char *pix = SOIL_load_image(im->file, &w, &h, &ch, SOIL_LOAD_AUTO);
+  if (pix == NULL || (ch != 3 && ch != 4))
+  {
+    if (pix != NULL)
+      SOIL_free_image_data(pix);
+    return;
+  }
+  im->iw = w;
+  im->ih = h;
+  im->w = tex_size(w);
+  im->h = tex_size(h);
+  unsigned char *lv0 = tex_pad(pix, w, h, ch, im->w, im->h);
+  if (lv0 == NULL)
+    return;
+  im->ch = ch;
+  im->pix = lv0;
+  im->mem = (lv0 == pix) ? TEXMEM_SOIL : TEXMEM_HEAP;
+
+  im->levels = tex_levels(im, im->w, im->h);
+  im->lofs[0] = 0;
+  if (im->levels > 1)
+  {
+    // level chain in one block
+    lv0 = malloc(tex_layout(im, 0));
+    if (lv0 != NULL)
+      memcpy(lv0, im->pix, (size_t)im->w * im->h * ch);
+    tex_free_pix(im);
+    if (lv0 == NULL)
+      return;
+    im->pix = lv0;
+    im->mem = TEXMEM_HEAP;
+    for (int l = 1; l < im->levels; l++)
+      tex_mipmap(im, l);
+  }
+
+  tex_cache_save(im, cache, &st);
+}
+
+// first queued image. call with the mutex held
+static TEXIMG *tex_claim(TEXLOAD *tl)
+{
+  for (int i = 0; i < TEX_IMG_LEN; i++)
+  {
+    TEXIMG *im = &tl->img[i];
+    if (im->state == TEX_WAIT)
+      return im;
+  }
+  return NULL;
+}
+
+// decode im with the mutex held. unlocked while decoding
+static void tex_decode_locked(TEXLOAD *tl, TEXIMG *im)
+{
+  im->state = TEX_DECODING;
+  mutex_unlock(&tl->mutex);
+  tex_decode(im);
+  mutex_lock(&tl->mutex);
+  im->state = (im->pix != NULL) ? TEX_DECODED : TEX_FAILED;
+  cond_broadcast(&tl->cond_done);
+}
+
+static THREAD_FUNC tex_loader(void *arg)
+{
+  TEXLOAD *tl = arg;
+  TEXIMG *im;
+
+  mutex_lock(&tl->mutex);
+  while (!tl->quit)
+  {
+    im = tex_claim(tl);
+    if (im == NULL)
+      cond_wait(&tl->cond_work, &tl->mutex);
+    else
+      tex_decode_locked(tl, im);
+  }
+  mutex_unlock(&tl->mutex);
+  return 0;
+}
+
+static TEXSTATE tex_state(TEXLOAD *tl, TEXIMG *im)
+{
+  mutex_lock(&tl->mutex);
+  TEXSTATE st = im->state;
+  mutex_unlock(&tl->mutex);
+  return st;
+}
+
+// loader threads read the states of all images
+static void tex_set_state(TEXLOAD *tl, TEXIMG *im, TEXSTATE st)
+{
+  mutex_lock(&tl->mutex);
+  im->state = st;
+  mutex_unlock(&tl->mutex);
+}
+
+// GL thread side. upload up to rows rows of im, returns rows uploaded
+static int tex_upload(TEXLOAD *tl, TEXIMG *im, int rows)
+{
+  GLenum fmt = (im->ch == 4) ? GL_RGBA : GL_RGB;
+
+  if (im->state == TEX_FAILED)
+  {
+    errmsg((im->tex == &gw.spr_tex) ? "Cannot load road image" : "Cannot load bg image");
+    tex_set_state(tl, im, TEX_DONE);
+    return 0;
+  }
+
+  if (im->state == TEX_DECODED)
+  {
+    // Texture parameters are stored in the texture object. Set them only here.
+    glGenTextures(1, &im->name);
+    gls_bind_texture(im->name);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, im->wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, im->wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (im->levels > 1) ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    if (gw.tex_max_level)
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, im->levels - 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, fmt, im->w, im->h, 0, fmt, GL_UNSIGNED_BYTE, NULL);
+    im->rows = 0;
+    tex_set_state(tl, im, TEX_UPLOADING);
+  }
+
+  int n = im->h - im->rows;
+  if (n > rows)
+    n = rows;
+  gls_bind_texture(im->name);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, im->rows, im->w, n, fmt, GL_UNSIGNED_BYTE,
+                  im->pix + im->lofs[0] + (size_t)im->rows * im->w * im->ch);
+  im->rows += n;
+
+  // mipmaps together with the last rows. a third of level 0 at most
+  if (im->rows >= im->h)
+  {
+    for (int l = 1; l < im->levels; l++)
+      glTexImage2D(GL_TEXTURE_2D, l, fmt, tex_level_w(im, l), tex_level_h(im, l), 0, fmt, GL_UNSIGNED_BYTE, im->pix + im->lofs[l]);
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+  if (im->rows >= im->h)
+  {
+    tex_free_pix(im);
+    if (im->uv != NULL)
+    {
+      im->uv[0] = (float)im->iw / im->w;
+      im->uv[1] = (float)im->ih / im->h;
+    }
+    *im->tex = im->name;
+    tex_set_state(tl, im, TEX_DONE);
+  }
+  return n;
+}
+
+// start decoding the sprites and the background of the stage
+void load_image(void)
+{
+  TEXLOAD *tl = &gw.texload;
+
+  // road uv stays inside its cell, so clamp is fine for road too
+  GLint clamp = (gw.renderer == RENDER_GL33) ? GL_CLAMP_TO_EDGE : GL_CLAMP;
+  // sprites have gutters. mipmaps up to the gutter width
+  tl->img[TEX_SPR] = (TEXIMG){SPRITES_IMG, &gw.spr_tex, clamp, TEX_WAIT, 1, 1};
+  for (int i = 0; i < 4; i++)
+  {
+    // bg scrolls horizontally. drawn minified, mipmapped.
+    // native size with NPOT textures, else padded
+    tl->img[TEX_BG0 + i] = (TEXIMG){bgimgs[i], &gw.bg_tex[i], GL_REPEAT, TEX_IDLE, 1, 0, gw.bg_uv[i]};
+  }
+  tl->img[TEX_BG0 + gw.stage_num].state = TEX_WAIT;
+
+  int threads = (gw.threads > 0) ? gw.threads : cpu_count();
+  if (threads > TEX_LOAD_THREADS)
+    threads = TEX_LOAD_THREADS;
+
+  mutex_init(&tl->mutex);
+  cond_init(&tl->cond_work);
+  cond_init(&tl->cond_done);
+  tl->quit = 0;
+  tl->started = 1;
+  tl->threads = 0;
+  for (int i = 0; i < threads; i++)
+  {
+#ifdef _WIN32
+    tl->th[i] = CreateThread(NULL, 0, tex_loader, tl, 0, NULL);
+    if (tl->th[i] == NULL)
+      break;
+#else
+    if (pthread_create(&tl->th[i], NULL, tex_loader, tl) != 0)
+      break;
+#endif
+    tl->threads++;
+  }
+}
+
+// upload some rows of the images decoded so far. once per frame
+void tex_load_poll(void)
+{
+  TEXLOAD *tl = &gw.texload;
+  int rows = TEX_UPLOAD_ROWS;
+
+  for (int i = 0; i < TEX_IMG_LEN && rows > 0; i++)
+  {
+    TEXIMG *im = &tl->img[i];
+    TEXSTATE st = tex_state(tl, im);
+    if (st == TEX_DECODED || st == TEX_FAILED || st == TEX_UPLOADING)
+      rows -= tex_upload(tl, im, rows);
+  }
+}
+
+// image id is used by this frame. decode here if no loader thread
+// took it yet, wait for it otherwise, then upload the rest of it
+void tex_load_need(TEXIMGID id)
+{
+  TEXLOAD *tl = &gw.texload;
+  TEXIMG *im = &tl->img[id];
+
+  mutex_lock(&tl->mutex);
+  if (im->state == TEX_IDLE || im->state == TEX_WAIT)
+    tex_decode_locked(tl, im);
+  while (im->state == TEX_DECODING)
+    cond_wait(&tl->cond_done, &tl->mutex);
+  mutex_unlock(&tl->mutex);
+
+  while (im->state != TEX_DONE)
+    tex_upload(tl, im, im->h);
+}
+
+// load id in the background
+void tex_load_request(TEXIMGID id)
+{
+  TEXLOAD *tl = &gw.texload;
+  TEXIMG *im = &tl->img[id];
+
+  mutex_lock(&tl->mutex);
+  if (im->state == TEX_IDLE)
+  {
+    im->state = TEX_WAIT;
+    cond_broadcast(&tl->cond_work);
+  }
+  mutex_unlock(&tl->mutex);
+}
+
+// drop id from memory, wherever it is in the pipeline
+void tex_load_release(TEXIMGID id)
+{
+  TEXLOAD *tl = &gw.texload;
+  TEXIMG *im = &tl->img[id];
+
+  mutex_lock(&tl->mutex);
+  while (im->state == TEX_DECODING)
+    cond_wait(&tl->cond_done, &tl->mutex);
+  if (im->state == TEX_IDLE)
+  {
+    mutex_unlock(&tl->mutex);
+    return;
+  }
+  im->state = TEX_IDLE;
+  mutex_unlock(&tl->mutex);
+
+  tex_free_pix(im);
+  if (im->name != 0)
+  {
+    if (gw.gls.tex == im->name)
+      gls_bind_texture(0);
+    glDeleteTextures(1, &im->name);
+    im->name = 0;
+  }
+  *im->tex = 0;
+}
+
+// keep the current stage's background and release the others.
+// at the start of the fade-out the next stage's one is prefetched
+void tex_load_stage(void)
+{
+  int next = (gw.stage_fix < 0) ? (gw.stage_num + 1) % 4 : gw.stage_num;
+
+  for (int i = 0; i < 4; i++)
+  {
+    if (i == gw.stage_num)
+      continue;
+    if (i == next && gw.step == 3)
+      tex_load_request(TEX_BG0 + i);
+    else
+      tex_load_release(TEX_BG0 + i);
+  }
+}
+
+void tex_load_stop(void)
+{
+  TEXLOAD *tl = &gw.texload;
+  if (!tl->started)
+    return;
+
+  // an image being decoded is finished first
+  mutex_lock(&tl->mutex);
+  tl->quit = 1;
+  cond_broadcast(&tl->cond_work);
+  mutex_unlock(&tl->mutex);
+
+  for (int i = 0; i < tl->threads; i++)
+  {
+#ifdef _WIN32
+    WaitForSingleObject(tl->th[i], INFINITE);
+    CloseHandle(tl->th[i]);
+#else
+    pthread_join(tl->th[i], NULL);
+#endif
+  }
+
+  for (int i = 0; i < TEX_IMG_LEN; i++)
+    tex_free_pix(&tl->img[i]);
+  tl->started = 0;
+}
+
+// state of the previous tick. interpolation starts from it
+static void sim_save_prev(void)
+{
+  gw.prev_camera_z = gw.camera_z;
+  gw.prev_bg_x = gw.bg_x;
+  gw.prev_bg_y = gw.bg_y;
+  for (int i = 0; i < gw.cars_len; i++)
+  {
+    gw.cars[i].px = gw.cars[i].x;
+    gw.cars[i].pdz = gw.cars[i].dz;
+  }
+}
+
+// one fixed step of the simulation. stage steps, camera, bg and cars
+static void sim_tick(float delta)
+{
+  int init = (gw.step == 0);
+
+  sim_save_prev();
+
+  switch (gw.step)
+  {
+  case 0:
+    // init work. wait for the images of this stage
+    init_work();
+    tex_load_need(TEX_SPR);
+    tex_load_need(TEX_BG0 + gw.stage_num);
+    tex_load_stage();
+    gw.fadev = 1.0;
+    gw.step++;
+    break;
+  case 1:
+    // fadein
+    gw.fadev -= ((1.0 / (gw.framerate * 1.3)) * gw.framerate * delta);
+    if (gw.fadev <= 0.0)
+    {
+      gw.fadev = 0.0;
+      gw.step++;
+    }
+    break;
+  case 2:
+    // main job
+    if (gw.laps >= gw.laps_limit)
+    {
+      gw.fadev = 0.0;
+      gw.step++;
+      tex_load_stage();
+    }
+    break;
+  case 3:
+    // fadeout
+    gw.fadev += ((1.0 / (gw.framerate * 2.0)) * gw.framerate * delta);
+    if (gw.fadev >= 1.0)
+    {
+      gw.fadev = 1.0;
+      gw.laps = 0;
+      gw.step = 0;
+      if (gw.stage_fix < 0)
+        gw.stage_num = (gw.stage_num + 1) % 4;
+    }
+    break;
+  default:
+    break;
+  }
+
+#if ACCEL
+  gw.spd += (gw.spda * gw.framerate * delta);
+#endif
+
+  if (gw.spd >= gw.spd_max_m)
+    gw.spd = gw.spd_max_m;
+
+  // move camera
+  gw.camera_z += (gw.spd * gw.framerate * delta);
+  gw.distance += (gw.spd * gw.framerate * delta);
+  if (gw.stream.enable)
+  {
+    update_stream();
+  }
+  else if (gw.camera_z >= gw.seg_total_length)
+  {
+    gw.camera_z -= gw.seg_total_length;
+    gw.prev_camera_z -= gw.seg_total_length;
+    gw.laps++;
+    gw.laps_total++;
+  }
+
+  int idx = (int)(gw.camera_z / gw.seg_length);
+  if (idx >= gw.seg_max)
+    idx = gw.seg_max - 1;
+  update_bg_pos(delta, gw.seg.curve[idx], gw.seg.pitch[idx]);
+
+  update_cars(delta);
+
+  // new stage. nothing to interpolate from
+  if (init)
+    sim_save_prev();
+}
+
+// run the ticks due, then place the camera, bg and cars of this frame
+// between the last two ticks
+void update(float delta)
+{
+  prof_start(PROF_UPDATE);
+
+  // the first frame of a stage runs its init tick at once
+  gw.sim_acc += delta;
+  if (gw.sim_acc > SIM_MAX_LAG)
+    gw.sim_acc = SIM_MAX_LAG;
+  while (gw.sim_acc >= SIM_DT - 1e-9 || gw.step == 0)
+  {
+    sim_tick(SIM_DT);
+    gw.sim_acc -= SIM_DT;
+  }
+  if (gw.sim_acc < 0.0)
+    gw.sim_acc = 0.0;
+  float a = gw.sim_acc / SIM_DT;
+
+  gw.view_z = gw.prev_camera_z + (gw.camera_z - gw.prev_camera_z) * a;
+  float dx = gw.bg_x - gw.prev_bg_x;
+  if (dx > 0.5)
+    dx -= 1.0;
+  else if (dx < -0.5)
+    dx += 1.0;
+  gw.view_bg_x = gw.prev_bg_x + dx * a;
+  gw.view_bg_y = gw.prev_bg_y + (gw.bg_y - gw.prev_bg_y) * a;
+
+  // get segment index. view_z is in 0 .. seg_total_length,
+  // a little below 0 just after a wrap
+  int idx = (int)(gw.view_z / gw.seg_length);
+  if (idx >= gw.seg_max)
+    idx = gw.seg_max - 1; // rounding just below the end
+
+  // record road segments position
+  PROJK pk;
+  proj_input(&pk, idx, gw.view_z);
+  project_road(&pk, idx);
+
+  // clear car draw flag
+  for (int k = 0; k < VIEW_DIST; k++)
+    gw.segc.cars[gw.dt.idx[k]] = 0;
+  prof_stop(PROF_UPDATE);
+
+  prof_start(PROF_CARS);
+  place_cars(a);
+  prof_stop(PROF_CARS);
+}
+
+void update_bg_pos(float delta, float curve, float pitch)
+{
+  gw.bg_x += ((curve * (gw.spd / gw.spd_max) * 0.01) * gw.framerate * delta);
+  gw.bg_x = fmodf(gw.bg_x, 1.0);
+
+  if (gw.spd > 0.0)
+  {
+    if (pitch != 0.0)
+    {
+      gw.bg_y += ((pitch * (gw.spd / gw.spd_max) * 0.02) * gw.framerate * delta);
+    }
+    else
+    {
+      float d = (((gw.spd / gw.spd_max) * 0.025) * gw.framerate * delta);
+      if (gw.bg_y < 0.0)
+      {
+        gw.bg_y += d * 0.1;
+        if (gw.bg_y >= 0.0)
+          gw.bg_y = 0.0;
+      }
+      if (gw.bg_y > 0.0)
+      {
+        gw.bg_y -= d * 0.1;
+        if (gw.bg_y <= 0.0)
+          gw.bg_y = 0.0;
+      }
+    }
+  }
+  if (gw.bg_y < -1.0)
+    gw.bg_y = -1.0;
+
+  if (gw.bg_y > 1.0)
+    gw.bg_y = 1.0;
+}
+
+static const SPRTYPE cars_spr_tbl[4][4] = {
+    {SPR_SCOOTER0, SPR_CAR0_0, SPR_CAR0_1, SPR_CAR0_2}, // stage 0
+    {SPR_SCOOTER1, SPR_CAR0_0, SPR_CAR0_1, SPR_CAR0_2}, // stage 1
+    {SPR_SCOOTER1, SPR_CAR0_0, SPR_CAR0_1, SPR_CAR0_2}, // stage 2
+    {SPR_SCOOTER3, SPR_CAR3_0, SPR_CAR3_1, SPR_CAR3_2}, // stage 3
+};
+
+// oncoming car left the course behind. loop course : to the end of it.
+// streaming course : back in ahead of the camera, dist * view distance
+static void wrap_oncoming_car(CARS *car, float dist)
+{
+  if (!gw.stream.enable)
+  {
+    if (car->z < 0.0)
+      car->z += gw.seg_total_length;
+    return;
+  }
+
+  if (car->z < gw.camera_z - gw.seg_length)
+    car->z = gw.camera_z + gw.seg_length * (VIEW_DIST - 2) * dist;
+}
+
+// one tick of car movement
+void update_cars(float delta)
+{
+  gw.angle += ((gw.spd * 1.0) * gw.framerate * delta);
+
+  for (int i = 0; i < gw.cars_len; i++)
+  {
+    float d, rx;
+    int kind = gw.cars[i].kind;
+    gw.cars[i].y = 0.0;
+    gw.cars[i].sprkind = cars_spr_tbl[gw.stage_num][kind];
+
+    switch (kind)
+    {
+    case 0:
+      // scooter
+      d = 170.0;
+      rx = gw.road_w * 0.5;
+      gw.cars[i].x = -rx * 1.35 + (rx * 0.25) * sin(0.035 * deg2rad(gw.angle));
+      gw.cars[i].z = gw.camera_z + d + (20.0 * sin(0.1 * deg2rad(gw.angle)));
+      break;
+    case 1:
+      d = 300.0;
+      gw.cars[i].x = -gw.road_w * 0.25;
+      gw.cars[i].z = gw.camera_z + d + 150.0 * sin(0.02 * deg2rad(gw.angle));
+      break;
+    case 2:
+      gw.cars[i].x = gw.road_w * 0.25;
+      gw.cars[i].z -= ((gw.spd_max * 0.25) * gw.framerate * delta);
+      wrap_oncoming_car(&gw.cars[i], 1.0);
+      break;
+    case 3:
+      gw.cars[i].x = gw.road_w * 0.7;
+      gw.cars[i].z -= ((gw.spd_max * 0.2) * gw.framerate * delta);
+      wrap_oncoming_car(&gw.cars[i], 0.6);
+      break;
+    default:
+      break;
+    }
+
+    // ahead of the camera, within one lap
+    float rel = gw.cars[i].z - gw.camera_z;
+    if (rel < 0.0)
+      rel += gw.seg_total_length;
+    if (rel >= gw.seg_total_length)
+      rel -= gw.seg_total_length;
+    gw.cars[i].dz = rel;
+  }
+}
+
+// cars of this frame, between the last two ticks. after project_road(),
+// gw.dt.idx[0] is the camera segment
+void place_cars(float a)
+{
+  int idx0 = gw.dt.idx[0];
+  float len = gw.seg_total_length;
+
+  for (int i = 0; i < gw.cars_len; i++)
+  {
+    CARS *car = &gw.cars[i];
+
+    // the short way around the ring. an oncoming car put back ahead
+    // of the camera jumps, no interpolation
+    float d = car->dz - car->pdz;
+    if (d > len / 2)
+      d -= len;
+    else if (d < -len / 2)
+      d += len;
+
+    float rel = car->pdz + d * a;
+    if (fabsf(d) > gw.seg_length * 4)
+      rel = car->dz;
+    if (rel < 0.0)
+      rel += len;
+    if (rel >= len)
+      rel -= len;
+    car->rz = gw.view_z + rel;
+    car->vx = car->px + (car->x - car->px) * a;
+
+    // set draw flag. only segments in view are read and cleared
+    int idx = (int)(car->rz / gw.seg_length);
+    if (idx < idx0 || idx >= idx0 + VIEW_DIST)
+      continue;
+    gw.segc.cars[idx] = gw.segc.cars[idx] | (1 << car->kind);
+  }
+}
+
+void draw_gl(void)
+{
+  if (gw.renderer == RENDER_GL33)
+    r33_begin_frame();
+
+  // init OpenGL
+  glViewport(0, 0, gw.scrw, gw.scrh);
+  set_proj_3d();
+
+  // clear screen
+  glClearColor(0, 0, 0, 1);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  prof_start(PROF_BG);
+  draw_bg();
+  prof_stop(PROF_BG);
+
+  prof_start(PROF_ROAD);
+  draw_road();
+
+  if (gw.fadev != 0.0)
+    draw_fadeout(gw.fadev);
+  prof_stop(PROF_ROAD);
+
+  // draw fps
+  prof_start(PROF_TEXT);
+  {
+    char buf[512];
+    sprintf(buf, "%d FPS", gw.count_fps);
+
+    float sdw = 0.07;
+    float x = -0.1;
+    float y = 10.0;
+
+    // shadow
+    set_color(0, 0, 0, 1);
+    draw_string(x + sdw, y - sdw, -gw.znear, buf, GL_FONT_PROFONT);
+
+    // text
+    set_color(1, 1, 1, 1);
+    draw_string(x, y, -gw.znear, buf, GL_FONT_PROFONT);
+  }
+
+  if (gw.prof.enable)
+    draw_prof_graph();
+  prof_stop(PROF_TEXT);
+
+  if (gw.renderer == RENDER_GL33)
+    r33_end_frame();
+}
+
+void draw_bg(void)
+{
+  float z, w, h, uw, vh, u, v;
+
+  z = gw.seg_length * (VIEW_DIST + 2);
+  h = z * tan(deg2rad(gw.fovy / 2.0));
+  w = h * (float)gw.scrw / (float)gw.scrh;
+
+  uw = 0.5;
+  vh = 0.5;
+  u = gw.view_bg_x;
+  v = (0.5 - (vh / 2)) - (gw.view_bg_y * (0.5 - (vh / 2)));
+  if (v < 0.0)
+    v = 0.0;
+  if (v > (1.0 - vh))
+    v = 1.0 - vh;
+
+  // image extent in the texture. below 1.0 when padded to power of two
+  float su = gw.bg_uv[gw.stage_num][0];
+  float sv = gw.bg_uv[gw.stage_num][1];
+  float v0 = v * sv;
+  float v1 = (v + vh) * sv;
+
+  VTXT q[8];
+  int n = 1;
+  if (su >= 1.0)
+  {
+    // GL_REPEAT wraps at the image edge
+    q[0] = (VTXT){u, v0, -w, h, -z};
+    q[1] = (VTXT){u, v1, -w, -h, -z};
+    q[2] = (VTXT){u + uw, v1, w, -h, -z};
+    q[3] = (VTXT){u + uw, v0, w, h, -z};
+  }
+  else
+  {
+    // padded. split the quad where the image wraps
+    u -= floor(u);
+    float u1 = u + uw;
+    float xm = w;
+    if (u1 > 1.0)
+    {
+      xm = -w + 2 * w * (1.0 - u) / uw;
+      q[4] = (VTXT){0, v0, xm, h, -z};
+      q[5] = (VTXT){0, v1, xm, -h, -z};
+      q[6] = (VTXT){(u1 - 1.0) * su, v1, w, -h, -z};
+      q[7] = (VTXT){(u1 - 1.0) * su, v0, w, h, -z};
+      u1 = 1.0;
+      n = 2;
+    }
+    q[0] = (VTXT){u * su, v0, -w, h, -z};
+    q[1] = (VTXT){u * su, v1, -w, -h, -z};
+    q[2] = (VTXT){u1 * su, v1, xm, -h, -z};
+    q[3] = (VTXT){u1 * su, v0, xm, h, -z};
+  }
+
+  gls_disable(GL_CULL_FACE);
+  gls_enable(GL_TEXTURE_2D);
+  gls_bind_texture(gw.bg_tex[gw.stage_num]);
+  gls_tex_env(GL_REPLACE);
+  set_color(1, 1, 1, 1);
+  draw_quads_t(q, n);
+  gls_disable(GL_TEXTURE_2D);
+}
+
+// vi : index in gw.dt
+void draw_car(int vi)
+{
+  int i = gw.dt.idx[vi];
+  int fg = gw.segc.cars[i];
+  if (fg == 0)
+    return;
+
+  for (int k = 0; k < gw.cars_len; k++)
+  {
+    if (fg & (1 << k) == 0)
+      continue;
+
+    float carz, sz0;
+    carz = gw.cars[k].rz;
+    sz0 = gw.seg.z[i];
+    if (carz < sz0 || (sz0 + gw.seg_length) < carz)
+      continue;
+
+    float rcx0, rcy0, rcx1, rcy1, p, cx0, cy0, z0;
+    rcx0 = gw.dt.x[vi];
+    rcy0 = gw.dt.y[vi];
+    rcx1 = gw.dt.x[vi + 1];
+    rcy1 = gw.dt.y[vi + 1];
+    p = (carz - sz0) / gw.seg_length;
+    cx0 = rcx0 + (rcx1 - rcx0) * p;
+    cy0 = rcy0 + (rcy1 - rcy0) * p + gw.cars[k].y;
+    z0 = gw.dt.z[vi] + gw.seg_length * p;
+
+    add_billboard(gw.cars[k].sprkind, gw.cars[k].vx, 1.0, cx0, cy0, z0);
+  }
+}
+
+static float gndcol[4][2][4] = {
+    {{0.45, 0.70, 0.25, 1}, {0.10, 0.68, 0.25, 1}}, // stage 0
+    {{0.80, 0.60, 0.40, 1}, {0.70, 0.50, 0.30, 1}}, // stage 1
+    {{0.95, 0.95, 0.95, 1}, {0.80, 0.80, 0.80, 1}}, // stage 2
+    {{0.10, 0.20, 0.05, 1}, {0.05, 0.15, 0.02, 1}}, // stage 3
+};
+
+void draw_road(void)
+{
+  // draw roads
+  float w, tanv, aspect;
+  w = gw.road_w;
+  tanv = tan(deg2rad(gw.fovy) / 2.0);
+  aspect = (float)gw.scrw / (float)gw.scrh;
+  int sn = gw.stage_num;
+
+  // get road texture u, v, uw, line height
+  float ru, rv, ruw, rvh;
+  const SPRTBL *rt = &spr_tbl[road_spr[gw.stage_num]];
+  ru = rt->u0;
+  rv = rt->v0;
+  ruw = rt->u1 - rt->u0;
+  rvh = (rt->v1 - rt->v0) / 16.0;
+
+  // build ground and road quads. far to near
+  VTXC *gp = gw.gnd_vtx;
+  VTXT *rp = gw.road_vtx;
+  for (int i = VIEW_DIST - 1; i >= 1; i--)
+  {
+    float x0, y0, z0, a0, x1, y1, z1;
+    int i2;
+
+    i2 = i - 1;
+    x0 = gw.dt.x[i];
+    y0 = gw.dt.y[i];
+    z0 = gw.dt.z[i];
+    a0 = gw.dt.attr[i];
+    x1 = gw.dt.x[i2];
+    y1 = gw.dt.y[i2];
+    z1 = gw.dt.z[i2];
+
+    // ground
+    {
+      float gndw0, gndw1, *col;
+      int cn;
+      gndw0 = tanv * z0 * aspect;
+      gndw1 = tanv * z1 * aspect;
+      cn = ((int)(a0 / 4) % 2 == 0) ? 0 : 1;
+      col = gndcol[sn][cn];
+      gp[0] = (VTXC){col[0], col[1], col[2], +gndw0, y0, -z0};
+      gp[1] = (VTXC){col[0], col[1], col[2], -gndw0, y0, -z0};
+      gp[2] = (VTXC){col[0], col[1], col[2], -gndw1, y1, -z1};
+      gp[3] = (VTXC){col[0], col[1], col[2], +gndw1, y1, -z1};
+      gp += 4;
+    }
+
+    // road
+    {
+      float u0, u1, v0, v1;
+      u0 = ru;
+      u1 = u0 + ruw;
+      v0 = a0 * rvh + rv;
+      v1 = v0 + rvh;
+      rp[0] = (VTXT){u1, v0, x0 + w, y0, -z0};
+      rp[1] = (VTXT){u0, v0, x0 - w, y0, -z0};
+      rp[2] = (VTXT){u0, v1, x1 - w, y1, -z1};
+      rp[3] = (VTXT){u1, v1, x1 + w, y1, -z1};
+      rp += 4;
+    }
+  }
+
+  // Ground and road are not drawn segment by segment any more.
+  // Use depth test so that near hills still hide far road and billboards.
+  int qcnt = VIEW_DIST - 1;
+
+  gls_enable(GL_DEPTH_TEST);
+  gls_depth_func(GL_LEQUAL);
+  gls_enable(GL_CULL_FACE);
+  gls_cull_face(GL_BACK);
+
+  // draw ground. push back a little, road is on the same plane
+  gls_disable(GL_TEXTURE_2D);
+  gls_enable(GL_POLYGON_OFFSET_FILL);
+  gls_polygon_offset(1.0, 1.0);
+  draw_quads_c(gw.gnd_vtx, qcnt);
+  gls_disable(GL_POLYGON_OFFSET_FILL);
+
+  // draw road
+  gls_enable(GL_TEXTURE_2D);
+  gls_bind_texture(gw.spr_tex);
+  gls_tex_env(GL_REPLACE);
+  set_color(1, 1, 1, 1);
+  draw_quads_t(gw.road_vtx, qcnt);
+
+  // collect billboards. far to near
+  gw.spr_cnt = 0;
+  for (int i = VIEW_DIST - 1; i >= 1; i--)
+  {
+    float x0, y0, z0;
+    float sprx, sprscale;
+    int sprkind, tidx, deli;
+
+    x0 = gw.dt.x[i];
+    y0 = gw.dt.y[i];
+    z0 = gw.dt.z[i];
+    deli = gw.dt.deli[i];
+    tidx = gw.dt.idx[i];
+    sprkind = gw.segc.sprkind[tidx];
+    sprx = gw.segc.sprx[tidx];
+    sprscale = gw.segc.sprscale[tidx];
+
+    add_billboard(sprkind, sprx, sprscale, x0, y0, z0);
+
+    if (deli != 0)
+    {
+      // draw delinator
+      SPRTYPE sk = (deli == 1) ? SPR_DELI0 : SPR_DELI1;
+      float sx = w * 1.05;
+      add_billboard(sk, -sx, 1.0, x0, y0, z0);
+      add_billboard(sk, +sx, 1.0, x0, y0, z0);
+    }
+
+    if (i < (VIEW_DIST - 2))
+      draw_car(i);
+  }
+
+  flush_billboards();
+
+  gls_disable(GL_TEXTURE_2D);
+  gls_disable(GL_DEPTH_TEST);
+}
+
+void draw_fadeout(float a)
+{
+  float z, w, h;
+  z = gw.znear;
+  h = z * tan(deg2rad(gw.fovy / 2.0));
+  w = h * (float)gw.scrw / (float)gw.scrh;
+
+  float q[4][3] = {{-w, h, -z}, {-w, -h, -z}, {+w, -h, -z}, {+w, h, -z}};
+
+  gls_disable(GL_TEXTURE_2D);
+  gls_enable(GL_BLEND);
+  gls_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  set_color(0.0, 0.0, 0.0, a);
+  draw_quad_fill(q);
+  gls_disable(GL_BLEND);
+}
+
+// ----------------------------------------
+// OpenGL 3.3 entry points. opengl32.dll exports only OpenGL 1.1,
+// so everything newer is loaded at run time in r33_init().
+#define R33_PROC_LIST                                              \
+  X(PFNGLCREATESHADERPROC, glCreateShader)                         \
+  X(PFNGLSHADERSOURCEPROC, glShaderSource)                         \
+  X(PFNGLCOMPILESHADERPROC, glCompileShader)                       \
+  X(PFNGLGETSHADERIVPROC, glGetShaderiv)                           \
+  X(PFNGLGETSHADERINFOLOGPROC, glGetShaderInfoLog)                 \
+  X(PFNGLDELETESHADERPROC, glDeleteShader)                         \
+  X(PFNGLCREATEPROGRAMPROC, glCreateProgram)                       \
+  X(PFNGLATTACHSHADERPROC, glAttachShader)                         \
+  X(PFNGLLINKPROGRAMPROC, glLinkProgram)                           \
+  X(PFNGLGETPROGRAMIVPROC, glGetProgramiv)                         \
+  X(PFNGLGETPROGRAMINFOLOGPROC, glGetProgramInfoLog)               \
+  X(PFNGLUSEPROGRAMPROC, glUseProgram)                             \
+  X(PFNGLGETUNIFORMLOCATIONPROC, glGetUniformLocation)             \
+  X(PFNGLUNIFORMMATRIX4FVPROC, glUniformMatrix4fv)                 \
+  X(PFNGLUNIFORM4FVPROC, glUniform4fv)                             \
+  X(PFNGLGENVERTEXARRAYSPROC, glGenVertexArrays)                   \
+  X(PFNGLBINDVERTEXARRAYPROC, glBindVertexArray)                   \
+  X(PFNGLENABLEVERTEXATTRIBARRAYPROC, glEnableVertexAttribArray)   \
+  X(PFNGLVERTEXATTRIBPOINTERPROC, glVertexAttribPointer)           \
+  X(PFNGLGENBUFFERSPROC, glGenBuffers)                             \
+  X(PFNGLBINDBUFFERPROC, glBindBuffer)                             \
+  X(PFNGLBUFFERDATAPROC, glBufferData)                             \
+  X(PFNGLMAPBUFFERRANGEPROC, glMapBufferRange)                     \
+  X(PFNGLUNMAPBUFFERPROC, glUnmapBuffer)                           \
+  X(PFNGLDRAWELEMENTSBASEVERTEXPROC, glDrawElementsBaseVertex)     \
+  X(PFNGLFENCESYNCPROC, glFenceSync)                               \
+  X(PFNGLCLIENTWAITSYNCPROC, glClientWaitSync)                     \
+  X(PFNGLDELETESYNCPROC, glDeleteSync)                             \
+  X(PFNGLGETSTRINGIPROC, glGetStringi)
+
+#define X(type, name) static type p_##name;
+R33_PROC_LIST
+#undef X
+
+// optional. GL 4.4 or GL_ARB_buffer_storage
+static PFNGLBUFFERSTORAGEPROC p_glBufferStorage;
+
+// ----------------------------------------
+// GL state cache.
+// All state changes go through here. Calls that set the value already
+// set are dropped, and counted.
+
+// forget everything. next call of each kind is always sent
+void gls_reset(void)
+{
+  GLSTATE *g = &gw.gls;
+  for (int i = 0; i < GLS_CAP_LEN; i++)
+    g->cap[i] = GLS_UNKNOWN;
+  g->tex = GLS_UNKNOWN;
+  g->blend_src = GLS_UNKNOWN;
+  g->blend_dst = GLS_UNKNOWN;
+  g->tex_env = GLS_UNKNOWN;
+  g->cull_face = GLS_UNKNOWN;
+  g->depth_func = GLS_UNKNOWN;
+  g->depth_mask = GLS_UNKNOWN;
+  g->poly_factor = NAN;
+  g->poly_units = NAN;
+  g->program = GLS_UNKNOWN;
+  g->vao = GLS_UNKNOWN;
+}
+
+void gls_new_frame(void)
+{
+  gw.gls.last_issued = gw.gls.issued;
+  gw.gls.last_saved = gw.gls.saved;
+  gw.gls.issued = 0;
+  gw.gls.saved = 0;
+}
+
+// return 1 if the call can be dropped
+static int gls_same(int same)
+{
+  if (same)
+    gw.gls.saved++;
+  else
+    gw.gls.issued++;
+  return same;
+}
+
+static int gls_cap_index(GLenum cap)
+{
+  switch (cap)
+  {
+  case GL_TEXTURE_2D:
+    return GLS_TEXTURE_2D;
+  case GL_BLEND:
+    return GLS_BLEND;
+  case GL_CULL_FACE:
+    return GLS_CULL_FACE;
+  case GL_DEPTH_TEST:
+    return GLS_DEPTH_TEST;
+  case GL_POLYGON_OFFSET_FILL:
+    return GLS_POLYGON_OFFSET_FILL;
+  default:
+    return -1;
+  }
+}
+
+void gls_enable(GLenum cap)
+{
+  int i = gls_cap_index(cap);
+  if (i >= 0)
+  {
+    if (gls_same(gw.gls.cap[i] == GL_TRUE))
+      return;
+    gw.gls.cap[i] = GL_TRUE;
+  }
+
+  // core profile has no GL_TEXTURE_2D enable. it selects the shader
+  if (cap == GL_TEXTURE_2D && gw.renderer == RENDER_GL33)
+    return;
+  glEnable(cap);
+}
+
+void gls_disable(GLenum cap)
+{
+  int i = gls_cap_index(cap);
+  if (i >= 0)
+  {
+    if (gls_same(gw.gls.cap[i] == GL_FALSE))
+      return;
+    gw.gls.cap[i] = GL_FALSE;
+  }
+
+  if (cap == GL_TEXTURE_2D && gw.renderer == RENDER_GL33)
+    return;
+  glDisable(cap);
+}
+
+void gls_bind_texture(GLuint tex)
+{
+  if (gls_same(gw.gls.tex == tex))
+    return;
+  gw.gls.tex = tex;
+  glBindTexture(GL_TEXTURE_2D, tex);
+}
+
+void gls_blend_func(GLenum src, GLenum dst)
+{
+  if (gls_same(gw.gls.blend_src == src && gw.gls.blend_dst == dst))
+    return;
+  gw.gls.blend_src = src;
+  gw.gls.blend_dst = dst;
+  glBlendFunc(src, dst);
+}
+
+void gls_tex_env(GLenum mode)
+{
+  if (gls_same(gw.gls.tex_env == mode))
+    return;
+  gw.gls.tex_env = mode;
+
+  // no texture env in core profile. shader always modulates by u_color
+  if (gw.renderer == RENDER_GL33)
+    return;
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, mode);
+}
+
+void gls_cull_face(GLenum mode)
+{
+  if (gls_same(gw.gls.cull_face == mode))
+    return;
+  gw.gls.cull_face = mode;
+  glCullFace(mode);
+}
+
+void gls_depth_func(GLenum func)
+{
+  if (gls_same(gw.gls.depth_func == func))
+    return;
+  gw.gls.depth_func = func;
+  glDepthFunc(func);
+}
+
+void gls_depth_mask(GLenum flag)
+{
+  if (gls_same(gw.gls.depth_mask == flag))
+    return;
+  gw.gls.depth_mask = flag;
+  glDepthMask(flag);
+}
+
+void gls_polygon_offset(float factor, float units)
+{
+  if (gls_same(gw.gls.poly_factor == factor && gw.gls.poly_units == units))
+    return;
+  gw.gls.poly_factor = factor;
+  gw.gls.poly_units = units;
+  glPolygonOffset(factor, units);
+}
+
+void gls_use_program(GLuint prg)
+{
+  if (gls_same(gw.gls.program == prg))
+    return;
+  gw.gls.program = prg;
+  p_glUseProgram(prg);
+}
+
+void gls_bind_vertex_array(GLuint vao)
+{
+  if (gls_same(gw.gls.vao == vao))
+    return;
+  gw.gls.vao = vao;
+  p_glBindVertexArray(vao);
+}
+
+// ----------------------------------------
+// Draw submission. same calls for both renderers.
+// GL 1.1 uses client side vertex arrays, GL 3.3 streams into the vbo ring.
+
+// 4x4 matrix, column major
+static void mat_perspective(float *m, float fovy, float aspect, float znear, float zfar)
+{
+  // same as gluPerspective()
+  float f = 1.0 / tan(deg2rad(fovy) / 2.0);
+  memset(m, 0, sizeof(float) * 16);
+  m[0] = f / aspect;
+  m[5] = f;
+  m[10] = (zfar + znear) / (znear - zfar);
+  m[11] = -1.0;
+  m[14] = (2.0 * zfar * znear) / (znear - zfar);
+}
+
+static void mat_ortho(float *m, float l, float r, float b, float t, float n, float f)
+{
+  // same as glOrtho()
+  memset(m, 0, sizeof(float) * 16);
+  m[0] = 2.0 / (r - l);
+  m[5] = 2.0 / (t - b);
+  m[10] = -2.0 / (f - n);
+  m[12] = -(r + l) / (r - l);
+  m[13] = -(t + b) / (t - b);
+  m[14] = -(f + n) / (f - n);
+  m[15] = 1.0;
+}
+
+// perspective for the road. modelview is always identity
+void set_proj_3d(void)
+{
+  if (gw.renderer == RENDER_GL33)
+  {
+    mat_perspective(gw.r33.mvp, gw.fovy, (float)gw.scrw / (float)gw.scrh, gw.znear, gw.zfar);
+    return;
+  }
+
+  glMatrixMode(GL_PROJECTION);
+  glLoadIdentity();
+  gluPerspective(gw.fovy, (double)gw.scrw / (double)gw.scrh, gw.znear, gw.zfar);
+  glMatrixMode(GL_MODELVIEW);
+  glLoadIdentity();
+}
+
+// screen pixel coordinates. origin is top-left
+void set_proj_2d(void)
+{
+  if (gw.renderer == RENDER_GL33)
+  {
+    mat_ortho(gw.r33.mvp, 0, gw.scrw, gw.scrh, 0, -1, 1);
+    return;
   }
 
-  // get segment index
-  int idx = 0;
-  if (gw.camera_z != 0.0)
+  glMatrixMode(GL_PROJECTION);
+  glLoadIdentity();
+  glOrtho(0, gw.scrw, gw.scrh, 0, -1, 1);
+  glMatrixMode(GL_MODELVIEW);
+  glLoadIdentity();
+}
+
+void set_color(float r, float g, float b, float a)
+{
+  if (gw.renderer == RENDER_GL33)
   {
-    idx = (int)(gw.camera_z / gw.seg_length) % gw.seg_max;
-    if (idx < 0)
-      idx += gw.seg_max;
+    gw.r33.color[0] = r;
+    gw.r33.color[1] = g;
+    gw.r33.color[2] = b;
+    gw.r33.color[3] = a;
+    return;
   }
 
-  float z, curve, pitch;
-  z = gw.segdata[idx].z;
-  curve = gw.segdata[idx].curve;
-  pitch = gw.segdata[idx].pitch;
+  glColor4f(r, g, b, a);
+}
 
-  update_bg_pos(delta, curve, pitch);
+static void r33_draw(R33KIND kind, const void *v, int n, const float *color);
 
-  // record road segments position
-  float ccz, camz, xd, yd, zd, cx, cy, cz;
-  ccz = fmodf(gw.camera_z, gw.seg_total_length);
-  camz = (ccz - z) / gw.seg_length;
-  xd = -camz * curve;
-  yd = -camz * pitch;
-  zd = gw.seg_length;
+// n colored quads. vertex color, alpha is 1
+void draw_quads_c(VTXC *v, int n)
+{
+  static const float white[4] = {1, 1, 1, 1};
 
-  cx = -(xd * camz);
-  cy = -(yd * camz);
-  cz = z - ccz;
+  if (n <= 0)
+    return;
 
-  for (int k = 0; k < VIEW_DIST; k++)
+  if (gw.renderer == RENDER_GL33)
   {
-    int i = (idx + k) % gw.seg_max;
-    float a = (float)((16 - 1) - (i % 16));
-    float x = cx + gw.shift_cam_x;
-    float y = cy + gw.road_y;
-    int deli = 0;
-    if (i < (gw.seg_max * 3 / 4))
-    {
-      deli = (i % 30 == 0) ? 1 : 0;
-    }
-    else
-    {
-      deli = (i % 20 == 0) ? 2 : 0;
-    }
-    gw.dt[k].x = x;
-    gw.dt[k].y = y;
-    gw.dt[k].z = cz;
-    gw.dt[k].attr = a;
-    gw.dt[k].deli = deli;
-    gw.dt[k].idx = i;
-    gw.dt[k].sprkind = gw.segdata[i].sprkind;
-    gw.dt[k].sprx = gw.segdata[i].sprx;
-    gw.dt[k].sprscale = gw.segdata[i].sprscale;
-    gw.segdata[i].x = x;
-    gw.segdata[i].y = y;
-    gw.segdata[i].cars = 0; // clear car draw flag
-    cx += xd;
-    cy += yd;
-    cz += zd;
-    xd += gw.segdata[i].curve;
-    yd += gw.segdata[i].pitch;
+    r33_draw(R33_COL, v, n, white);
+    return;
   }
 
-  update_cars(delta);
+  glInterleavedArrays(GL_C3F_V3F, 0, v);
+  glDrawArrays(GL_QUADS, 0, n * 4);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glDisableClientState(GL_COLOR_ARRAY);
 }
 
-void update_bg_pos(float delta, float curve, float pitch)
+// n textured quads. bound texture, current color
+void draw_quads_t(VTXT *v, int n)
 {
-  gw.bg_x += ((curve * (gw.spd / gw.spd_max) * 0.01) * gw.framerate * delta);
-  gw.bg_x = fmodf(gw.bg_x, 1.0);
+  if (n <= 0)
+    return;
 
-  if (gw.spd > 0.0)
+  if (gw.renderer == RENDER_GL33)
   {
-    if (pitch != 0.0)
-    {
-      gw.bg_y += ((pitch * (gw.spd / gw.spd_max) * 0.02) * gw.framerate * delta);
-    }
-    else
-    {
-      float d = (((gw.spd / gw.spd_max) * 0.025) * gw.framerate * delta);
-      if (gw.bg_y < 0.0)
-      {
-        gw.bg_y += d * 0.1;
-        if (gw.bg_y >= 0.0)
-          gw.bg_y = 0.0;
-      }
-      if (gw.bg_y > 0.0)
-      {
-        gw.bg_y -= d * 0.1;
-        if (gw.bg_y <= 0.0)
-          gw.bg_y = 0.0;
-      }
-    }
+    r33_draw(R33_TEX, v, n, gw.r33.color);
+    return;
   }
-  if (gw.bg_y < -1.0)
-    gw.bg_y = -1.0;
 
-  if (gw.bg_y > 1.0)
-    gw.bg_y = 1.0;
+  glInterleavedArrays(GL_T2F_V3F, 0, v);
+  glDrawArrays(GL_QUADS, 0, n * 4);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
 }
 
-static const SPRTYPE cars_spr_tbl[4][4] = {
-    {SPR_SCOOTER0, SPR_CAR0_0, SPR_CAR0_1, SPR_CAR0_2}, // stage 0
-    {SPR_SCOOTER1, SPR_CAR0_0, SPR_CAR0_1, SPR_CAR0_2}, // stage 1
-    {SPR_SCOOTER1, SPR_CAR0_0, SPR_CAR0_1, SPR_CAR0_2}, // stage 2
-    {SPR_SCOOTER3, SPR_CAR3_0, SPR_CAR3_1, SPR_CAR3_2}, // stage 3
-};
-
-void update_cars(float delta)
+// one quad filled with current color
+void draw_quad_fill(float v[4][3])
 {
-  gw.angle += ((gw.spd * 1.0) * gw.framerate * delta);
-
-  for (int i = 0; i < gw.cars_len; i++)
+  if (gw.renderer == RENDER_GL33)
   {
-    float d, rx;
-    int kind = gw.cars[i].kind;
-    gw.cars[i].y = 0.0;
-    gw.cars[i].sprkind = cars_spr_tbl[gw.stage_num][kind];
-
-    switch (kind)
-    {
-    case 0:
-      // scooter
-      d = 170.0;
-      rx = gw.road_w * 0.5;
-      gw.cars[i].x = -rx * 1.35 + (rx * 0.25) * sin(0.035 * deg2rad(gw.angle));
-      gw.cars[i].z = gw.camera_z + d + (20.0 * sin(0.1 * deg2rad(gw.angle)));
-      break;
-    case 1:
-      d = 300.0;
-      gw.cars[i].x = -gw.road_w * 0.25;
-      gw.cars[i].z = gw.camera_z + d + 150.0 * sin(0.02 * deg2rad(gw.angle));
-      break;
-    case 2:
-      gw.cars[i].x = gw.road_w * 0.25;
-      gw.cars[i].z -= ((gw.spd_max * 0.25) * gw.framerate * delta);
-      if (gw.cars[i].z < 0.0)
-        gw.cars[i].z += gw.seg_total_length;
-      break;
-    case 3:
-      gw.cars[i].x = gw.road_w * 0.7;
-      gw.cars[i].z -= ((gw.spd_max * 0.2) * gw.framerate * delta);
-      if (gw.cars[i].z < 0.0)
-        gw.cars[i].z += gw.seg_total_length;
-      break;
-    default:
-      break;
-    }
-
-    // set draw flag
-    int idx = (int)(gw.cars[i].z / gw.seg_length) % gw.seg_max;
-    if (idx < 0)
-      idx += gw.seg_max;
-    gw.segdata[idx].cars = gw.segdata[idx].cars | (1 << kind);
+    VTXC q[4];
+    for (int i = 0; i < 4; i++)
+      q[i] = (VTXC){1, 1, 1, v[i][0], v[i][1], v[i][2]};
+    r33_draw(R33_COL, q, 1, gw.r33.color);
+    return;
   }
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, 0, v);
+  glDrawArrays(GL_QUADS, 0, 4);
+  glDisableClientState(GL_VERTEX_ARRAY);
 }
 
-void draw_gl(void)
+static void r33_draw_string(float x, float y, float z, char *str, int kind);
+
+// bitmap font text. (x, y, z) is the lower left, like glRasterPos3f()
+void draw_string(float x, float y, float z, char *str, int kind)
 {
-  // init OpenGL
-  glViewport(0, 0, gw.scrw, gw.scrh);
-  glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
-  gluPerspective(gw.fovy, (double)gw.scrw / (double)gw.scrh, gw.znear, gw.zfar);
-  glMatrixMode(GL_MODELVIEW);
+  if (gw.renderer == RENDER_GL33)
+  {
+    r33_draw_string(x, y, z, str, kind);
+    return;
+  }
 
-  // clear screen
-  glClearColor(0, 0, 0, 1);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  glRasterPos3f(x, y, z);
+  glBitmapFontDrawString(str, kind);
+}
 
-  draw_bg();
+// ----------------------------------------
+// OpenGL 3.3 core renderer.
+// Two programs: vertex colored (ground, fill) and textured (bg, road,
+// billboards, text). Fixed function state (blend, depth, cull) is shared
+// with the GL 1.1 path through the state cache. Vertices are copied into
+// one vbo split into R33_RING_LEN frame regions, guarded by fences, and
+// drawn as triangles through a static quad index buffer.
+
+static const char *r33_vs_src[R33_KIND_LEN] = {
+    // R33_COL
+    "#version 330 core\n"
+    "layout(location = 0) in vec3 a_col;\n"
+    "layout(location = 1) in vec3 a_pos;\n"
+    "uniform mat4 u_mvp;\n"
+    "uniform vec4 u_color;\n"
+    "out vec4 v_col;\n"
+    "void main()\n"
+    "{\n"
+    "  v_col = vec4(a_col, 1.0) * u_color;\n"
+    "  gl_Position = u_mvp * vec4(a_pos, 1.0);\n"
+    "}\n",
+
+    // R33_TEX
+    "#version 330 core\n"
+    "layout(location = 0) in vec2 a_uv;\n"
+    "layout(location = 1) in vec3 a_pos;\n"
+    "uniform mat4 u_mvp;\n"
+    "out vec2 v_uv;\n"
+    "void main()\n"
+    "{\n"
+    "  v_uv = a_uv;\n"
+    "  gl_Position = u_mvp * vec4(a_pos, 1.0);\n"
+    "}\n",
+};
 
-  glLoadIdentity();
-  glTranslatef(0, 0, 0);
+static const char *r33_fs_src[R33_KIND_LEN] = {
+    // R33_COL
+    "#version 330 core\n"
+    "in vec4 v_col;\n"
+    "out vec4 frag_color;\n"
+    "void main()\n"
+    "{\n"
+    "  frag_color = v_col;\n"
+    "}\n",
+
+    // R33_TEX
+    "#version 330 core\n"
+    "in vec2 v_uv;\n"
+    "uniform sampler2D u_tex;\n"
+    "uniform vec4 u_color;\n"
+    "out vec4 frag_color;\n"
+    "void main()\n"
+    "{\n"
+    "  frag_color = texture(u_tex, v_uv) * u_color;\n"
+    "}\n",
+};
 
-  draw_road();
+static const int r33_stride[R33_KIND_LEN] = {
+    sizeof(VTXC),
+    sizeof(VTXT),
+};
 
-  if (gw.fadev != 0.0)
-    draw_fadeout(gw.fadev);
+typedef void (*R33PROC)(void);
 
-  // draw fps
-  {
-    char buf[512];
-    sprintf(buf, "%d FPS", gw.count_fps);
+static R33PROC r33_get_proc(const char *name)
+{
+#ifdef USE_EGL
+  if (gw.headless)
+    return (R33PROC)eglGetProcAddress(name);
+#endif
+  return (R33PROC)glfwGetProcAddress(name);
+}
 
-    float sdw = 0.07;
-    float x = -0.1;
-    float y = 10.0;
+static int r33_has_extension(const char *name)
+{
+  GLint n = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+  for (int i = 0; i < n; i++)
+  {
+    const char *ext = (const char *)p_glGetStringi(GL_EXTENSIONS, i);
+    if (ext != NULL && strcmp(ext, name) == 0)
+      return 1;
+  }
+  return 0;
+}
 
-    // shadow
-    glColor4f(0, 0, 0, 1);
-    glRasterPos3f(x + sdw, y - sdw, -gw.znear);
-    glBitmapFontDrawString(buf, GL_FONT_PROFONT);
+static GLuint r33_compile(GLenum type, const char *src)
+{
+  GLuint sh = p_glCreateShader(type);
+  GLint ok = 0;
 
-    // text
-    glColor4f(1, 1, 1, 1);
-    glRasterPos3f(x, y, -gw.znear);
-    glBitmapFontDrawString(buf, GL_FONT_PROFONT);
+  p_glShaderSource(sh, 1, &src, NULL);
+  p_glCompileShader(sh);
+  p_glGetShaderiv(sh, GL_COMPILE_STATUS, &ok);
+  if (!ok)
+  {
+    char log[1024];
+    p_glGetShaderInfoLog(sh, sizeof(log), NULL, log);
+    fprintf(stderr, "%s", log);
+    error_exit("Cannot compile shader");
   }
+  return sh;
 }
 
-void draw_bg(void)
+static GLuint r33_link(const char *vs_src, const char *fs_src)
 {
-  float z, w, h, uw, vh, u, v;
+  GLuint vs = r33_compile(GL_VERTEX_SHADER, vs_src);
+  GLuint fs = r33_compile(GL_FRAGMENT_SHADER, fs_src);
+  GLuint prg = p_glCreateProgram();
+  GLint ok = 0;
+
+  p_glAttachShader(prg, vs);
+  p_glAttachShader(prg, fs);
+  p_glLinkProgram(prg);
+  p_glGetProgramiv(prg, GL_LINK_STATUS, &ok);
+  if (!ok)
+  {
+    char log[1024];
+    p_glGetProgramInfoLog(prg, sizeof(log), NULL, log);
+    fprintf(stderr, "%s", log);
+    error_exit("Cannot link shader program");
+  }
 
-  z = gw.seg_length * (VIEW_DIST + 2);
-  h = z * tan(deg2rad(gw.fovy / 2.0));
-  w = h * (float)gw.scrw / (float)gw.scrh;
+  // program keeps them
+  p_glDeleteShader(vs);
+  p_glDeleteShader(fs);
+  return prg;
+}
 
-  uw = 0.5;
-  vh = 0.5;
-  u = gw.bg_x;
-  v = (0.5 - (vh / 2)) - (gw.bg_y * (0.5 - (vh / 2)));
-  if (v < 0.0)
-    v = 0.0;
-  if (v > (1.0 - vh))
-    v = 1.0 - vh;
+void r33_init(void)
+{
+  R33 *r = &gw.r33;
+  GLsizeiptr total = (GLsizeiptr)R33_RING_SIZE * R33_RING_LEN;
+
+  // load entry points
+#define X(type, name)                                  \
+  p_##name = (type)r33_get_proc(#name);                \
+  if (p_##name == NULL)                                \
+    error_exit("Cannot get OpenGL function " #name);
+  R33_PROC_LIST
+#undef X
+
+  for (int i = 0; i < R33_KIND_LEN; i++)
+  {
+    r->prg[i] = r33_link(r33_vs_src[i], r33_fs_src[i]);
+    r->u_mvp[i] = p_glGetUniformLocation(r->prg[i], "u_mvp");
+    r->u_color[i] = p_glGetUniformLocation(r->prg[i], "u_color");
+  }
 
-  glDisable(GL_CULL_FACE);
-  glLoadIdentity();
-  glEnable(GL_TEXTURE_2D);
-  glBindTexture(GL_TEXTURE_2D, gw.bg_tex[gw.stage_num]);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-
-  glBegin(GL_QUADS);
-  glColor4f(1, 1, 1, 1);
-  glTexCoord2f(u, v);
-  glVertex3f(-w, h, -z);
-  glTexCoord2f(u, v + vh);
-  glVertex3f(-w, -h, -z);
-  glTexCoord2f(u + uw, v + vh);
-  glVertex3f(w, -h, -z);
-  glTexCoord2f(u + uw, v);
-  glVertex3f(w, h, -z);
-  glEnd();
-  glDisable(GL_TEXTURE_2D);
-}
-
-void draw_car(int i)
-{
-  int fg = gw.segdata[i].cars;
-  if (fg == 0)
-    return;
+  // streaming vbo. stays bound to GL_ARRAY_BUFFER
+  p_glGenBuffers(1, &r->vbo);
+  p_glBindBuffer(GL_ARRAY_BUFFER, r->vbo);
+  r->map = NULL;
+  if (r33_has_extension("GL_ARB_buffer_storage"))
+    p_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)r33_get_proc("glBufferStorage");
+  if (p_glBufferStorage != NULL)
+  {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    p_glBufferStorage(GL_ARRAY_BUFFER, total, NULL, flags);
+    r->map = p_glMapBufferRange(GL_ARRAY_BUFFER, 0, total, flags);
+  }
+  if (r->map == NULL)
+    p_glBufferData(GL_ARRAY_BUFFER, total, NULL, GL_STREAM_DRAW);
 
-  for (int k = 0; k < gw.cars_len; k++)
+  // quad index pattern. 0,1,2 0,2,3 keeps the GL_QUADS winding
   {
-    if (fg & (1 << k) == 0)
-      continue;
+    static GLushort idx[R33_QUAD_MAX * 6];
+    for (int i = 0; i < R33_QUAD_MAX; i++)
+    {
+      GLushort v = i * 4;
+      GLushort *p = &idx[i * 6];
+      p[0] = v;
+      p[1] = v + 1;
+      p[2] = v + 2;
+      p[3] = v;
+      p[4] = v + 2;
+      p[5] = v + 3;
+    }
 
-    float carz, sz0;
-    carz = fmodf(gw.cars[k].z, gw.seg_total_length);
-    sz0 = gw.segdata[i].z;
-    if (carz < sz0 || (sz0 + gw.seg_length) < carz)
-      continue;
+    // vertex layouts. attrib pointers start at vbo offset 0,
+    // each draw selects its vertices with base vertex
+    p_glGenVertexArrays(R33_KIND_LEN, r->vao);
+    p_glGenBuffers(1, &r->ibo);
+    for (int i = 0; i < R33_KIND_LEN; i++)
+    {
+      GLsizei st = r33_stride[i];
+      int n0 = (i == R33_COL) ? 3 : 2;
+
+      p_glBindVertexArray(r->vao[i]);
+      p_glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, r->ibo);
+      if (i == 0)
+        p_glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(idx), idx, GL_STATIC_DRAW);
+      p_glEnableVertexAttribArray(0);
+      p_glVertexAttribPointer(0, n0, GL_FLOAT, GL_FALSE, st, (void *)0);
+      p_glEnableVertexAttribArray(1);
+      p_glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, st, (void *)(sizeof(float) * n0));
+    }
+    p_glBindVertexArray(0);
+  }
 
-    int i2;
-    float rcx0, rcy0, rcx1, rcy1, p, cx0, cy0, rcz, z0;
-    i2 = (i + 1) % gw.seg_max;
-    rcx0 = gw.segdata[i].x;
-    rcy0 = gw.segdata[i].y;
-    rcx1 = gw.segdata[i2].x;
-    rcy1 = gw.segdata[i2].y;
-    p = (carz - sz0) / gw.seg_length;
-    cx0 = rcx0 + (rcx1 - rcx0) * p;
-    cy0 = rcy0 + (rcy1 - rcy0) * p + gw.cars[k].y;
-    rcz = fmodf(gw.camera_z, gw.seg_total_length);
-    z0 = sz0 - rcz;
-    if (z0 < 0)
-      z0 += gw.seg_total_length;
-    z0 += gw.seg_length * p;
+  r->ring = 0;
+  r->used = 0;
+  for (int i = 0; i < R33_RING_LEN; i++)
+    r->fence[i] = NULL;
+  for (int i = 0; i < 4; i++)
+    r->color[i] = 1.0;
 
-    draw_billboard(gw.cars[k].sprkind, gw.cars[k].x, 1.0, cx0, cy0, z0);
-  }
+  gls_reset();
 }
 
-static float gndcol[4][2][4] = {
-    {{0.45, 0.70, 0.25, 1}, {0.10, 0.68, 0.25, 1}}, // stage 0
-    {{0.80, 0.60, 0.40, 1}, {0.70, 0.50, 0.30, 1}}, // stage 1
-    {{0.95, 0.95, 0.95, 1}, {0.80, 0.80, 0.80, 1}}, // stage 2
-    {{0.10, 0.20, 0.05, 1}, {0.05, 0.15, 0.02, 1}}, // stage 3
-};
-
-void draw_road(void)
+// move to the next frame region. wait until the GPU is done with it
+static void r33_begin_frame(void)
 {
-  glEnable(GL_CULL_FACE);
-  glCullFace(GL_BACK);
+  R33 *r = &gw.r33;
 
-  glEnable(GL_TEXTURE_2D);
-  glBindTexture(GL_TEXTURE_2D, gw.spr_tex);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+  r->ring = (r->ring + 1) % R33_RING_LEN;
+  r->used = 0;
 
-  // draw roads
-  float w, tanv, aspect;
-  w = gw.road_w;
-  tanv = tan(deg2rad(gw.fovy) / 2.0);
-  aspect = (float)gw.scrw / (float)gw.scrh;
-  int sn = gw.stage_num;
+  GLsync fence = r->fence[r->ring];
+  if (fence != NULL)
+  {
+    GLenum st;
+    do
+    {
+      st = p_glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    } while (st == GL_TIMEOUT_EXPIRED);
+    p_glDeleteSync(fence);
+    r->fence[r->ring] = NULL;
+  }
+}
 
-  // get road texture u, v, uw, uh
-  float ru, rv, ruw, rvh;
-  ru = road_uv[gw.stage_num][0];
-  rv = road_uv[gw.stage_num][1];
-  ruw = road_uv[gw.stage_num][2];
-  rvh = road_uv[gw.stage_num][3];
+static void r33_end_frame(void)
+{
+  R33 *r = &gw.r33;
+  r->fence[r->ring] = p_glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
 
-  for (int i = VIEW_DIST - 1; i >= 1; i--)
+// copy vertices into this frame region. return base vertex, or -1 if full
+static int r33_stream(const void *data, size_t size, size_t stride)
+{
+  R33 *r = &gw.r33;
+  size_t base = (size_t)r->ring * R33_RING_SIZE;
+  size_t ofs = (base + r->used + stride - 1) / stride * stride;
+
+  if (ofs + size > base + R33_RING_SIZE)
   {
-    float x0, y0, z0, a0, x1, y1, z1;
-    float sprx, sprscale;
-    int i2, sprkind, tidx, deli;
+    if (!r->overflow)
+      errmsg("Vertex stream buffer is full");
+    r->overflow = 1;
+    return -1;
+  }
 
-    i2 = i - 1;
-    x0 = gw.dt[i].x;
-    y0 = gw.dt[i].y;
-    z0 = gw.dt[i].z;
-    a0 = gw.dt[i].attr;
-    deli = gw.dt[i].deli;
-    x1 = gw.dt[i2].x;
-    y1 = gw.dt[i2].y;
-    z1 = gw.dt[i2].z;
-    sprkind = gw.dt[i].sprkind;
-    sprx = gw.dt[i].sprx;
-    sprscale = gw.dt[i].sprscale;
-    tidx = gw.dt[i].idx;
-
-    // draw ground
-    if (1)
-    {
-      float gndw0, gndw1;
-      int cn;
-      gndw0 = tanv * z0 * aspect;
-      gndw1 = tanv * z1 * aspect;
-      glDisable(GL_TEXTURE_2D);
-      cn = ((int)(a0 / 4) % 2 == 0) ? 0 : 1;
-      glColor4f(gndcol[sn][cn][0], gndcol[sn][cn][1], gndcol[sn][cn][2], gndcol[sn][cn][3]);
-      glBegin(GL_QUADS);
-      glVertex3f(+gndw0, y0, -z0);
-      glVertex3f(-gndw0, y0, -z0);
-      glVertex3f(-gndw1, y1, -z1);
-      glVertex3f(+gndw1, y1, -z1);
-      glEnd();
-    }
+  if (r->map != NULL)
+  {
+    memcpy(r->map + ofs, data, size);
+  }
+  else
+  {
+    // region is fenced, no need to sync here
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+    void *p = p_glMapBufferRange(GL_ARRAY_BUFFER, ofs, size, flags);
+    if (p == NULL)
+      return -1;
+    memcpy(p, data, size);
+    p_glUnmapBuffer(GL_ARRAY_BUFFER);
+  }
 
-    // draw road
-    {
-      float u0, u1, v0, v1;
-      u0 = ru;
-      u1 = u0 + ruw;
-      v0 = a0 * rvh;
-      v1 = v0 + rvh;
-      v0 = v0 * rvh + rv;
-      v1 = v1 * rvh + rv;
+  r->used = ofs + size - base;
+  return (int)(ofs / stride);
+}
 
-      glEnable(GL_TEXTURE_2D);
-      glBegin(GL_QUADS);
-      glColor4f(1, 1, 1, 1);
-      glTexCoord2f(u1, v0);
-      glVertex3f(x0 + w, y0, -z0);
-      glTexCoord2f(u0, v0);
-      glVertex3f(x0 - w, y0, -z0);
-      glTexCoord2f(u0, v1);
-      glVertex3f(x1 - w, y1, -z1);
-      glTexCoord2f(u1, v1);
-      glVertex3f(x1 + w, y1, -z1);
-      glEnd();
-    }
+static void r33_draw(R33KIND kind, const void *v, int n, const float *color)
+{
+  R33 *r = &gw.r33;
 
-    draw_billboard(sprkind, sprx, sprscale, x0, y0, z0);
+  if (n > R33_QUAD_MAX)
+    n = R33_QUAD_MAX;
 
-    if (deli != 0)
-    {
-      // draw delinator
-      SPRTYPE sk = (deli == 1) ? SPR_DELI0 : SPR_DELI1;
-      float sx = w * 1.05;
-      draw_billboard(sk, -sx, 1.0, x0, y0, z0);
-      draw_billboard(sk, +sx, 1.0, x0, y0, z0);
-    }
+  int bv = r33_stream(v, (size_t)n * 4 * r33_stride[kind], r33_stride[kind]);
+  if (bv < 0)
+    return;
 
-    if (i < (VIEW_DIST - 2))
-      draw_car(tidx);
+  gls_use_program(r->prg[kind]);
+  gls_bind_vertex_array(r->vao[kind]);
+  p_glUniformMatrix4fv(r->u_mvp[kind], 1, GL_FALSE, r->mvp);
+  p_glUniform4fv(r->u_color[kind], 1, color);
+  p_glDrawElementsBaseVertex(GL_TRIANGLES, n * 6, GL_UNSIGNED_SHORT, NULL, bv);
+}
+
+// font glyphs in a 16 x 6 cell texture. made on first use.
+// red channel is the bitmap, swizzled to alpha
+static GLuint r33_font_texture(int kind)
+{
+  R33 *r = &gw.r33;
+  if (r->font_tex[kind] != 0)
+    return r->font_tex[kind];
+
+  FONTDATA *fd = &fontdatatbl[kind];
+  int w = fd->width;
+  int h = fd->height;
+  int bpr = (w + 7) / 8;
+  int tw = w * 16;
+  int th = h * 6;
+  unsigned char *buf = calloc((size_t)tw * th, 1);
+  if (buf == NULL)
+    error_exit("Cannot allocate font texture buffer");
+
+  // glBitmap rows are bottom to top, MSB first. keep that order
+  for (int c = 0; c < 96; c++)
+  {
+    unsigned char *src = fd->adrs + fd->chrlen * c;
+    unsigned char *dst = buf + (size_t)(c / 16) * h * tw + (c % 16) * w;
+    for (int y = 0; y < h; y++)
+      for (int x = 0; x < w; x++)
+        if (src[y * bpr + x / 8] & (0x80 >> (x % 8)))
+          dst[y * tw + x] = 0xff;
   }
 
-  glDisable(GL_TEXTURE_2D);
+  static const GLint swz[4] = {GL_ONE, GL_ONE, GL_ONE, GL_RED};
+  glGenTextures(1, &r->font_tex[kind]);
+  gls_bind_texture(r->font_tex[kind]);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, tw, th, 0, GL_RED, GL_UNSIGNED_BYTE, buf);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swz);
+  free(buf);
+
+  return r->font_tex[kind];
 }
 
-void draw_fadeout(float a)
+static void r33_draw_string(float x, float y, float z, char *str, int kind)
 {
-  float z, w, h;
-  z = gw.znear;
-  h = z * tan(deg2rad(gw.fovy / 2.0));
-  w = h * (float)gw.scrw / (float)gw.scrh;
+  R33 *r = &gw.r33;
+  FONTDATA *fd = &fontdatatbl[kind];
+  float *m = r->mvp;
+  float save_mvp[16];
+  VTXT q[R33_TEXT_MAX * 4];
+  int n = 0;
+
+  // raster position. project to window coordinates
+  float cx = m[0] * x + m[4] * y + m[8] * z + m[12];
+  float cy = m[1] * x + m[5] * y + m[9] * z + m[13];
+  float cw = m[3] * x + m[7] * y + m[11] * z + m[15];
+  if (cw == 0.0)
+    return;
+  float wx = floorf((cx / cw * 0.5 + 0.5) * gw.scrw);
+  float wy = floorf((cy / cw * 0.5 + 0.5) * gw.scrh);
+
+  float tw = fd->width * 16;
+  float th = fd->height * 6;
+  for (int i = 0; str[i] != 0 && n < R33_TEXT_MAX; i++)
+  {
+    int c = str[i];
+    if (c < 0x20 || c > 0x7f)
+      c = 0x20;
+    c -= 0x20;
+
+    float x0 = wx + fd->width * i;
+    float x1 = x0 + fd->width;
+    float y0 = wy;
+    float y1 = y0 + fd->height;
+    float u0 = (c % 16) * fd->width / tw;
+    float u1 = u0 + fd->width / tw;
+    float v0 = (c / 16) * fd->height / th;
+    float v1 = v0 + fd->height / th;
+
+    VTXT *p = &q[n * 4];
+    p[0] = (VTXT){u0, v0, x0, y0, 0};
+    p[1] = (VTXT){u1, v0, x1, y0, 0};
+    p[2] = (VTXT){u1, v1, x1, y1, 0};
+    p[3] = (VTXT){u0, v1, x0, y1, 0};
+    n++;
+  }
+
+  memcpy(save_mvp, r->mvp, sizeof(save_mvp));
+  mat_ortho(r->mvp, 0, gw.scrw, 0, gw.scrh, -1, 1);
 
-  glDisable(GL_TEXTURE_2D);
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-  glColor4f(0.0, 0.0, 0.0, a);
-  glBegin(GL_QUADS);
-  glVertex3f(-w, h, -z);
-  glVertex3f(-w, -h, -z);
-  glVertex3f(+w, -h, -z);
-  glVertex3f(+w, h, -z);
-  glEnd();
-  glDisable(GL_BLEND);
+  gls_enable(GL_TEXTURE_2D);
+  gls_bind_texture(r33_font_texture(kind));
+  gls_enable(GL_BLEND);
+  gls_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  r33_draw(R33_TEX, q, n, r->color);
+  gls_disable(GL_BLEND);
+  gls_disable(GL_TEXTURE_2D);
+
+  memcpy(r->mvp, save_mvp, sizeof(save_mvp));
 }
 
-void draw_billboard(int spkind, float spx, float spscale, float cx0, float y0, float z0)
+// ----------------------------------------
+// add billboard quad to batch. call in back to front order
+void add_billboard(int spkind, float spx, float spscale, float cx0, float y0, float z0)
 {
-  if (spkind == 0)
+  // sprkind can come from a course file. out of range draws nothing
+  if (spkind <= 0 || spkind >= (int)SPR_TBL_LEN)
     return;
 
-  int n;
-  float w, h, u0, v0, u1, v1, x, y, z, ud, vd;
+  float w, h, x, z, xl, xr, yb, yt;
 
   if (gw.disable_tree != 0)
   {
@@ -1639,46 +5613,54 @@ void draw_billboard(int spkind, float spx, float spscale, float cx0, float y0, f
       spkind = SPR_GRASS0 + (gw.stage_num * 1);
   }
 
-  w = (spr_tbl[spkind].w / 2) * spscale;
-  h = spr_tbl[spkind].h * spscale;
+  const SPRTBL *t = &spr_tbl[spkind];
+  w = t->w * spscale;
+  h = t->h * spscale;
   if (w == 0.0 || h == 0.0)
     return;
 
-  ud = (1.0 / SPRTEXIMG_W);
-  vd = (1.0 / SPRTEXIMG_H);
-  u0 = spr_tbl[spkind].u + ud * 0.5;
-  v0 = spr_tbl[spkind].v + vd * 0.5;
-  u1 = u0 + spr_tbl[spkind].uw - ud * 1.0;
-  v1 = v0 + spr_tbl[spkind].vh - vd * 1.0;
+  if (gw.spr_cnt >= SPR_BATCH_MAX)
+    flush_billboards();
 
-  x = cx0 + spx;
-  y = y0;
+  // whole cell is w x h, centered on x, bottom on y0.
+  // the quad covers only the trimmed box of it
+  x = cx0 + spx - w / 2;
   z = z0;
+  xl = x + w * t->x0;
+  xr = x + w * t->x1;
+  yb = y0 + h * t->y0;
+  yt = y0 + h * t->y1;
+
+  VTXT *p = &gw.spr_vtx[gw.spr_cnt * 4];
+  p[0] = (VTXT){t->u0, t->v0, xl, yt, -z};
+  p[1] = (VTXT){t->u0, t->v1, xl, yb, -z};
+  p[2] = (VTXT){t->u1, t->v1, xr, yb, -z};
+  p[3] = (VTXT){t->u1, t->v0, xr, yt, -z};
+  gw.spr_cnt++;
+}
+
+// draw all billboards in batch with one state setup
+void flush_billboards(void)
+{
+  if (gw.spr_cnt == 0)
+    return;
+
+  gls_enable(GL_TEXTURE_2D);
+  gls_bind_texture(gw.spr_tex);
+  gls_tex_env(GL_REPLACE);
+  gls_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  gls_enable(GL_BLEND);
+
+  // test against ground and road, but do not write depth.
+  // billboards are sorted back to front
+  gls_depth_mask(GL_FALSE);
+
+  set_color(1, 1, 1, 1);
+  draw_quads_t(gw.spr_vtx, gw.spr_cnt);
+
+  gls_depth_mask(GL_TRUE);
+  gls_disable(GL_BLEND);
+  gls_disable(GL_TEXTURE_2D);
 
-  glEnable(GL_TEXTURE_2D);
-  glBindTexture(GL_TEXTURE_2D, gw.spr_tex);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-  // glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  // glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-  glEnable(GL_BLEND);
-
-  glBegin(GL_QUADS);
-  glColor4f(1, 1, 1, 1);
-  glTexCoord2f(u0, v0);
-  glVertex3f(x - w, y + h, -z);
-  glTexCoord2f(u0, v1);
-  glVertex3f(x - w, y, -z);
-  glTexCoord2f(u1, v1);
-  glVertex3f(x + w, y, -z);
-  glTexCoord2f(u1, v0);
-  glVertex3f(x + w, y + h, -z);
-  glEnd();
-
-  glDisable(GL_BLEND);
-  glDisable(GL_TEXTURE_2D);
+  gw.spr_cnt = 0;
 }
@@ -0,0 +1,234 @@
+#!python
+# -*- mode: python; Encoding: utf-8; coding: utf-8 -*-
+"""
+sprite atlas packer. Makes the sprite atlas and the C language table
+
+Usage: python atlaspack.py [-s SHEET] [-d DIR] [-o ATLAS.png] [-H HEADER.h] INPUT.csv
+
+INPUT.csv is the sprite list. One "idx,name,poly w,poly h,x,y,w,h" line
+per sprite, in SPRTYPE order. Each sprite image is DIR/name.png if it
+exists, otherwise the x,y,w,h cell of SHEET. Cells are on a 4096 x 4096
+grid, scaled to the sheet size on each axis.
+
+Each sprite is trimmed to its opaque pixels, surrounded by a gutter that
+repeats its edge pixels, and packed (skyline bottom-left, tallest first)
+on gutter*2 aligned columns, so mipmaps up to the gutter width do not
+bleed. The header holds SPRTYPE, the table of poly size, trimmed box and
+uv, and the atlas size.
+
+Requires Pillow.
+"""
+
+import sys
+import os
+import csv
+import argparse
+import hashlib
+
+from PIL import Image
+
+GRID = 4096
+
+
+def pot(n):
+    x = 1
+    while x < n:
+        x *= 2
+    return x
+
+
+def load_sprites(rows, sheet, sprdir, trim):
+    sx = (sheet.width / GRID) if sheet is not None else 1.0
+    sy = (sheet.height / GRID) if sheet is not None else 1.0
+    sprs = []
+    for row in rows:
+        name = row[1]
+        polyw, polyh = int(row[2]), int(row[3])
+        cell = [int(v) for v in row[4:8]]
+        d = {"name": name, "polyw": polyw, "polyh": polyh, "img": None}
+        sprs.append(d)
+        if cell[2] == 0 or cell[3] == 0:
+            continue
+
+        fn = os.path.join(sprdir, name + ".png") if sprdir else None
+        if fn and os.path.exists(fn):
+            img = Image.open(fn).convert("RGBA")
+        elif sheet is not None:
+            x, y = int(cell[0] * sx + 0.5), int(cell[1] * sy + 0.5)
+            w, h = int(cell[2] * sx + 0.5), int(cell[3] * sy + 0.5)
+            img = sheet.crop((x, y, x + w, y + h))
+        else:
+            sys.exit("%s : no image. give -s SHEET or %s" % (name, fn))
+
+        # trimmed box. l, t, r, b in pixels of the sprite image
+        box = img.getchannel("A").getbbox() if trim else None
+        if box is None:
+            box = (0, 0, img.width, img.height)
+        d["img"] = img.crop(box)
+        d["box"] = box
+        d["size"] = img.size
+    return sprs
+
+
+def pack(sprs, width, gutter, align):
+    order = [i for i, d in enumerate(sprs) if d["img"] is not None]
+    order.sort(key=lambda i: (-sprs[i]["img"].height, -sprs[i]["img"].width, i))
+
+    cols = width // align
+    sky = [0] * cols
+    top = 0
+    for i in order:
+        d = sprs[i]
+        cw = d["img"].width + gutter * 2
+        ch = d["img"].height + gutter * 2
+        wc = (cw + align - 1) // align
+        ch = (ch + align - 1) // align * align
+        if wc > cols:
+            sys.exit("%s : wider than the atlas" % d["name"])
+
+        # lowest place, leftmost on ties
+        bx, by = 0, None
+        for x in range(cols - wc + 1):
+            y = max(sky[x:x + wc])
+            if by is None or y < by:
+                bx, by = x, y
+
+        for j in range(bx, bx + wc):
+            sky[j] = by + ch
+        top = max(top, by + ch)
+        d["pos"] = (bx * align + gutter, by + gutter)
+    return pot(top)
+
+
+def pad(img, g):
+    w, h = img.size
+    im = Image.new("RGBA", (w + g * 2, h + g * 2))
+    im.paste(img, (g, g))
+    im.paste(img.crop((0, 0, 1, h)).resize((g, h)), (0, g))
+    im.paste(img.crop((w - 1, 0, w, h)).resize((g, h)), (w + g, g))
+    im.paste(im.crop((0, g, w + g * 2, g + 1)).resize((w + g * 2, g)), (0, 0))
+    im.paste(im.crop((0, h + g - 1, w + g * 2, h + g)).resize((w + g * 2, g)), (0, h + g))
+    return im
+
+
+def make_atlas(sprs, width, height, gutter):
+    atlas = Image.new("RGBA", (width, height))
+    for d in sprs:
+        if d["img"] is not None:
+            x, y = d["pos"]
+            atlas.paste(pad(d["img"], gutter), (x - gutter, y - gutter))
+    return atlas
+
+
+def make_table(sprs, width, height):
+    tbl = []
+    for d in sprs:
+        e = {"name": "SPR_" + d["name"].upper(), "w": d["polyw"], "h": d["polyh"]}
+        e["box"] = (0.0, 0.0, 0.0, 0.0)
+        e["uv"] = (0.0, 0.0, 0.0, 0.0)
+        if d["img"] is not None:
+            l, t, r, b = d["box"]
+            sw, sh = d["size"]
+            # box in the cell. 0.0 - 1.0, y from the bottom
+            e["box"] = (l / sw, (sh - b) / sh, r / sw, (sh - t) / sh)
+            x, y = d["pos"]
+            e["uv"] = (
+                x / width,
+                y / height,
+                (x + d["img"].width) / width,
+                (y + d["img"].height) / height,
+            )
+        tbl.append(e)
+    return tbl
+
+
+def write_header(f, src, tbl, width, height, gutter):
+    h = hashlib.blake2b(digest_size=8)
+    h.update(repr((width, height, gutter, [(e["box"], e["uv"]) for e in tbl])).encode())
+    layout = h.hexdigest()
+
+    f.write("// generated by images/atlaspack.py from %s. do not edit\n\n" % src)
+    f.write("// atlas size in pixels, and the gutter around each cell\n")
+    f.write("#define SPRATLAS_W %d\n" % width)
+    f.write("#define SPRATLAS_H %d\n" % height)
+    f.write("#define SPR_GUTTER %d\n" % gutter)
+    f.write("#define SPRATLAS_LAYOUT 0x%sULL\n\n" % layout)
+
+    f.write("""\
+// ----------------------------------------
+// sprite type
+typedef enum sprtype
+{
+""")
+    n = max(len(e["name"]) for e in tbl) + 1
+    for i, e in enumerate(tbl):
+        f.write("  %-*s // %d\n" % (n, e["name"] + ",", i))
+    f.write("} SPRTYPE;\n\n")
+
+    f.write("""\
+// ----------------------------------------
+// sprites size, trimmed box and uv table
+typedef struct sprtbl
+{
+  float w;  // poly size of the whole cell
+  float h;
+  float x0; // trimmed box in the cell. 0.0 - 1.0, from the bottom left
+  float y0;
+  float x1;
+  float y1;
+  float u0; // uv of the trimmed box in the atlas
+  float v0;
+  float u1;
+  float v1;
+} SPRTBL;
+
+""")
+    f.write("static const SPRTBL spr_tbl[%d] = {\n" % len(tbl))
+    f.write("    // poly w, poly h, x0, y0, x1, y1, u0, v0, u1, v1\n")
+    lines = []
+    for e in tbl:
+        v = (e["w"], e["h"]) + e["box"] + e["uv"]
+        lines.append("{%d, %d, %f, %f, %f, %f, %f, %f, %f, %f}," % v)
+    n = max(len(s) for s in lines)
+    for i, e in enumerate(tbl):
+        f.write("    %-*s // %d %s\n" % (n, lines[i], i, e["name"]))
+    f.write("};\n")
+
+
+def main():
+    ap = argparse.ArgumentParser(description="sprite atlas packer")
+    ap.add_argument("csv", help="sprite list")
+    ap.add_argument("-s", "--sheet", help="sprite sheet, cells on a %d grid" % GRID)
+    ap.add_argument("-d", "--dir", help="directory of NAME.png sprite images")
+    ap.add_argument("-o", "--out", default="sprites_atlas.png", help="atlas image")
+    ap.add_argument("-H", "--header", default="spr_tbl.h", help="C header")
+    ap.add_argument("-W", "--width", type=int, default=GRID, help="atlas width")
+    ap.add_argument("-g", "--gutter", type=int, default=16, help="gutter in pixels")
+    ap.add_argument("--no-trim", action="store_true", help="keep whole cells")
+    args = ap.parse_args()
+
+    if args.width != pot(args.width):
+        sys.exit("atlas width must be a power of two")
+    if args.gutter < 1:
+        sys.exit("gutter must be 1 or more")
+
+    with open(args.csv) as f:
+        rows = [r for r in csv.reader(f) if r]
+
+    sheet = None
+    if args.sheet and os.path.exists(args.sheet):
+        sheet = Image.open(args.sheet).convert("RGBA")
+
+    sprs = load_sprites(rows, sheet, args.dir, not args.no_trim)
+    height = pack(sprs, args.width, args.gutter, args.gutter * 2)
+    make_atlas(sprs, args.width, height, args.gutter).save(args.out)
+    tbl = make_table(sprs, args.width, height)
+    with open(args.header, "w", newline="\r\n") as f:
+        write_header(f, os.path.basename(args.csv), tbl, args.width, height, args.gutter)
+
+    used = sum((d["img"].width + args.gutter * 2) * (d["img"].height + args.gutter * 2) for d in sprs if d["img"] is not None)
+    print("%s : %d x %d, %d%% used" % (args.out, args.width, height, used * 100 // (args.width * height)))
+
+
+if __name__ == "__main__":
+    main()
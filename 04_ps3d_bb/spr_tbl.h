@@ -0,0 +1,169 @@
+// generated by images/atlaspack.py from uvpostbl.csv. do not edit
+
+// atlas size in pixels, and the gutter around each cell
+#define SPRATLAS_W 4096
+#define SPRATLAS_H 2048
+#define SPR_GUTTER 16
+#define SPRATLAS_LAYOUT 0x633e601067654d30ULL
+
+// ----------------------------------------
+// sprite type
+typedef enum sprtype
+{
+  SPR_NONE,      // 0
+  SPR_TREE0_0,   // 1
+  SPR_TREE0_1,   // 2
+  SPR_TREE0_2,   // 3
+  SPR_TREE0_3,   // 4
+  SPR_TREE1_0,   // 5
+  SPR_TREE1_1,   // 6
+  SPR_TREE1_2,   // 7
+  SPR_TREE1_3,   // 8
+  SPR_TREE2_0,   // 9
+  SPR_TREE2_1,   // 10
+  SPR_TREE2_2,   // 11
+  SPR_TREE2_3,   // 12
+  SPR_TREE3_0,   // 13
+  SPR_TREE3_1,   // 14
+  SPR_TREE3_2,   // 15
+  SPR_TREE3_3,   // 16
+  SPR_SLOPE0_L,  // 17
+  SPR_SLOPE0_R,  // 18
+  SPR_SLOPE1_L,  // 19
+  SPR_SLOPE1_R,  // 20
+  SPR_SLOPE2_L,  // 21
+  SPR_SLOPE2_R,  // 22
+  SPR_SLOPE3_L,  // 23
+  SPR_SLOPE3_R,  // 24
+  SPR_WALL0,     // 25
+  SPR_WALL1,     // 26
+  SPR_WALL2,     // 27
+  SPR_WALL3,     // 28
+  SPR_GRASS0,    // 29
+  SPR_GRASS1,    // 30
+  SPR_GRASS2,    // 31
+  SPR_GRASS3,    // 32
+  SPR_SCOOTER0,  // 33
+  SPR_SCOOTER1,  // 34
+  SPR_SCOOTER3,  // 35
+  SPR_CAR0_0,    // 36
+  SPR_CAR0_1,    // 37
+  SPR_CAR0_2,    // 38
+  SPR_CAR3_0,    // 39
+  SPR_CAR3_1,    // 40
+  SPR_CAR3_2,    // 41
+  SPR_HOUSE0_0L, // 42
+  SPR_HOUSE0_0R, // 43
+  SPR_HOUSE0_1L, // 44
+  SPR_HOUSE0_1R, // 45
+  SPR_HOUSE0_2L, // 46
+  SPR_HOUSE0_2R, // 47
+  SPR_HOUSE2_0L, // 48
+  SPR_HOUSE2_0R, // 49
+  SPR_HOUSE2_1L, // 50
+  SPR_HOUSE2_1R, // 51
+  SPR_HOUSE2_2L, // 52
+  SPR_HOUSE2_2R, // 53
+  SPR_HOUSE3_0L, // 54
+  SPR_HOUSE3_0R, // 55
+  SPR_HOUSE3_1L, // 56
+  SPR_HOUSE3_1R, // 57
+  SPR_HOUSE3_2L, // 58
+  SPR_HOUSE3_2R, // 59
+  SPR_BEAM,      // 60
+  SPR_ARROWR2L,  // 61
+  SPR_ARROWL2R,  // 62
+  SPR_DELI0,     // 63
+  SPR_DELI1,     // 64
+  SPR_ROAD0,     // 65
+  SPR_ROAD1,     // 66
+  SPR_ROAD2,     // 67
+} SPRTYPE;
+
+// ----------------------------------------
+// sprites size, trimmed box and uv table
+typedef struct sprtbl
+{
+  float w;  // poly size of the whole cell
+  float h;
+  float x0; // trimmed box in the cell. 0.0 - 1.0, from the bottom left
+  float y0;
+  float x1;
+  float y1;
+  float u0; // uv of the trimmed box in the atlas
+  float v0;
+  float u1;
+  float v1;
+} SPRTBL;
+
+static const SPRTBL spr_tbl[68] = {
+    // poly w, poly h, x0, y0, x1, y1, u0, v0, u1, v1
+    {0, 0, 0.000000, 0.000000, 0.000000, 0.000000, 0.000000, 0.000000, 0.000000, 0.000000},      // 0 SPR_NONE
+    {450, 450, 0.066406, 0.001953, 1.000000, 0.919922, 0.628906, 0.257812, 0.687256, 0.487305},  // 1 SPR_TREE0_0
+    {450, 450, 0.000000, 0.001953, 0.992188, 0.898438, 0.699219, 0.257812, 0.761230, 0.481934},  // 2 SPR_TREE0_1
+    {450, 450, 0.023438, 0.001953, 1.000000, 0.851562, 0.769531, 0.257812, 0.830566, 0.470215},  // 3 SPR_TREE0_2
+    {450, 450, 0.000000, 0.001953, 0.976562, 0.837891, 0.839844, 0.257812, 0.900879, 0.466797},  // 4 SPR_TREE0_3
+    {450, 450, 0.250000, 0.001953, 1.000000, 0.703125, 0.074219, 0.476562, 0.121094, 0.651855},  // 5 SPR_TREE1_0
+    {450, 450, 0.000000, 0.001953, 0.812500, 0.703125, 0.503906, 0.273438, 0.554688, 0.448730},  // 6 SPR_TREE1_1
+    {450, 450, 0.187500, 0.001953, 1.000000, 0.703125, 0.566406, 0.273438, 0.617188, 0.448730},  // 7 SPR_TREE1_2
+    {450, 450, 0.000000, 0.001953, 0.750000, 0.703125, 0.128906, 0.476562, 0.175781, 0.651855},  // 8 SPR_TREE1_3
+    {450, 450, 0.003906, 0.001953, 1.000000, 0.953125, 0.558594, 0.007812, 0.620850, 0.245605},  // 9 SPR_TREE2_0
+    {450, 450, 0.000000, 0.751953, 0.996094, 0.953125, 0.886719, 0.773438, 0.948975, 0.823730},  // 10 SPR_TREE2_1
+    {450, 450, 0.031250, 0.001953, 0.968750, 0.984375, 0.285156, 0.007812, 0.343750, 0.253418},  // 11 SPR_TREE2_2
+    {450, 450, 0.000000, 0.000000, 1.000000, 1.000000, 0.003906, 0.007812, 0.066406, 0.257812},  // 12 SPR_TREE2_3
+    {450, 450, 0.093750, 0.001953, 1.000000, 0.921875, 0.910156, 0.007812, 0.966797, 0.237793},  // 13 SPR_TREE3_0
+    {450, 450, 0.000000, 0.001953, 0.906250, 1.000000, 0.214844, 0.007812, 0.271484, 0.257324},  // 14 SPR_TREE3_1
+    {450, 450, 0.031250, 0.001953, 1.000000, 0.765625, 0.910156, 0.257812, 0.970703, 0.448730},  // 15 SPR_TREE3_2
+    {450, 450, 0.000000, 0.001953, 0.968750, 0.765625, 0.003906, 0.273438, 0.064453, 0.464355},  // 16 SPR_TREE3_3
+    {500, 500, 0.187500, 0.001953, 1.000000, 0.978516, 0.355469, 0.007812, 0.406250, 0.251953},  // 17 SPR_SLOPE0_L
+    {500, 500, 0.000000, 0.001953, 0.945312, 0.974609, 0.417969, 0.007812, 0.477051, 0.250977},  // 18 SPR_SLOPE0_R
+    {500, 500, 0.000000, 0.001953, 1.000000, 0.937500, 0.628906, 0.007812, 0.691406, 0.241699},  // 19 SPR_SLOPE1_L
+    {500, 500, 0.000000, 0.671875, 1.000000, 0.906250, 0.816406, 0.773438, 0.878906, 0.832031},  // 20 SPR_SLOPE1_R
+    {500, 500, 0.031250, 0.001953, 1.000000, 0.578125, 0.394531, 0.476562, 0.455078, 0.620605},  // 21 SPR_SLOPE2_L
+    {500, 500, 0.000000, 0.001953, 0.996094, 0.578125, 0.324219, 0.476562, 0.386475, 0.620605},  // 22 SPR_SLOPE2_R
+    {500, 500, 0.031250, 0.001953, 1.000000, 0.937500, 0.699219, 0.007812, 0.759766, 0.241699},  // 23 SPR_SLOPE3_L
+    {500, 500, 0.000000, 0.001953, 0.968750, 0.937500, 0.769531, 0.007812, 0.830078, 0.241699},  // 24 SPR_SLOPE3_R
+    {2800, 700, 0.164062, 0.000000, 0.972656, 0.933594, 0.316406, 0.648438, 0.417480, 0.765137}, // 25 SPR_WALL0
+    {2800, 700, 0.000000, 0.000000, 0.953125, 0.875000, 0.003906, 0.773438, 0.123047, 0.882812}, // 26 SPR_WALL1
+    {2800, 700, 0.035156, 0.000000, 0.900391, 0.156250, 0.136719, 0.789062, 0.244873, 0.808594}, // 27 SPR_WALL2
+    {2800, 700, 0.000000, 0.000000, 1.000000, 1.000000, 0.769531, 0.492188, 0.894531, 0.617188}, // 28 SPR_WALL3
+    {200, 50, 0.332031, 0.000000, 1.000000, 1.000000, 0.496094, 0.773438, 0.537842, 0.835938},   // 29 SPR_GRASS0
+    {200, 50, 0.000000, 0.000000, 1.000000, 1.000000, 0.675781, 0.648438, 0.738281, 0.710938},   // 30 SPR_GRASS1
+    {200, 50, 0.003906, 0.000000, 1.000000, 1.000000, 0.425781, 0.773438, 0.488037, 0.835938},   // 31 SPR_GRASS2
+    {200, 50, 0.000000, 0.000000, 1.000000, 1.000000, 0.675781, 0.726562, 0.738281, 0.789062},   // 32 SPR_GRASS3
+    {35, 70, 0.062500, 0.001953, 1.000000, 0.562500, 0.003906, 0.492188, 0.033203, 0.632324},    // 33 SPR_SCOOTER0
+    {35, 70, 0.000000, 0.001953, 1.000000, 0.562500, 0.910156, 0.476562, 0.941406, 0.616699},    // 34 SPR_SCOOTER1
+    {35, 70, 0.000000, 0.001953, 1.000000, 0.562500, 0.949219, 0.476562, 0.980469, 0.616699},    // 35 SPR_SCOOTER3
+    {100, 100, 0.003906, 0.001953, 1.000000, 0.562500, 0.464844, 0.476562, 0.527100, 0.616699},  // 36 SPR_CAR0_0
+    {100, 100, 0.000000, 0.001953, 0.968750, 0.562500, 0.535156, 0.476562, 0.595703, 0.616699},  // 37 SPR_CAR0_1
+    {100, 100, 0.003906, 0.001953, 1.000000, 0.968750, 0.488281, 0.007812, 0.550537, 0.249512},  // 38 SPR_CAR0_2
+    {100, 100, 0.000000, 0.001953, 0.996094, 0.921875, 0.839844, 0.007812, 0.902100, 0.237793},  // 39 SPR_CAR3_0
+    {100, 100, 0.000000, 0.000000, 1.000000, 1.000000, 0.074219, 0.007812, 0.136719, 0.257812},  // 40 SPR_CAR3_1
+    {100, 100, 0.000000, 0.000000, 1.000000, 1.000000, 0.144531, 0.007812, 0.207031, 0.257812},  // 41 SPR_CAR3_2
+    {500, 375, 0.003906, 0.000000, 1.000000, 0.994792, 0.363281, 0.273438, 0.425537, 0.459961},  // 42 SPR_HOUSE0_0L
+    {500, 375, 0.000000, 0.000000, 0.230469, 0.567708, 0.972656, 0.632812, 0.987061, 0.739258},  // 43 SPR_HOUSE0_0R
+    {500, 375, 0.769531, 0.000000, 1.000000, 0.567708, 0.425781, 0.648438, 0.440186, 0.754883},  // 44 SPR_HOUSE0_1L
+    {500, 375, 0.000000, 0.000000, 0.996094, 0.994792, 0.433594, 0.273438, 0.495850, 0.459961},  // 45 SPR_HOUSE0_1R
+    {600, 300, 0.035156, 0.003906, 1.000000, 0.937500, 0.605469, 0.648438, 0.665771, 0.765137},  // 46 SPR_HOUSE0_2L
+    {600, 300, 0.000000, 0.000000, 1.000000, 1.000000, 0.605469, 0.507812, 0.667969, 0.632812},  // 47 SPR_HOUSE0_2R
+    {500, 375, 0.003906, 0.000000, 1.000000, 1.000000, 0.214844, 0.273438, 0.277100, 0.460938},  // 48 SPR_HOUSE2_0L
+    {500, 375, 0.000000, 0.000000, 1.000000, 1.000000, 0.074219, 0.273438, 0.136719, 0.460938},  // 49 SPR_HOUSE2_0R
+    {500, 375, 0.000000, 0.000000, 1.000000, 1.000000, 0.144531, 0.273438, 0.207031, 0.460938},  // 50 SPR_HOUSE2_1L
+    {500, 375, 0.000000, 0.669271, 0.996094, 1.000000, 0.746094, 0.773438, 0.808350, 0.835449},  // 51 SPR_HOUSE2_1R
+    {600, 300, 0.000000, 0.000000, 1.000000, 1.000000, 0.675781, 0.507812, 0.738281, 0.632812},  // 52 SPR_HOUSE2_2L
+    {600, 300, 0.000000, 0.000000, 1.000000, 1.000000, 0.464844, 0.632812, 0.527344, 0.757812},  // 53 SPR_HOUSE2_2R
+    {500, 375, 0.757812, 0.171875, 1.000000, 1.000000, 0.980469, 0.007812, 0.995605, 0.163086},  // 54 SPR_HOUSE3_0L
+    {500, 375, 0.000000, 0.171875, 1.000000, 1.000000, 0.183594, 0.476562, 0.246094, 0.631836},  // 55 SPR_HOUSE3_0R
+    {500, 375, 0.000000, 0.171875, 1.000000, 1.000000, 0.253906, 0.476562, 0.316406, 0.631836},  // 56 SPR_HOUSE3_1L
+    {500, 375, 0.000000, 0.333333, 0.500000, 1.000000, 0.746094, 0.632812, 0.777344, 0.757812},  // 57 SPR_HOUSE3_1R
+    {600, 300, 0.000000, 0.003906, 1.000000, 0.957031, 0.902344, 0.632812, 0.964844, 0.751953},  // 58 SPR_HOUSE3_2L
+    {600, 300, 0.000000, 0.000000, 1.000000, 1.000000, 0.535156, 0.632812, 0.597656, 0.757812},  // 59 SPR_HOUSE3_2R
+    {1000, 500, 0.000000, 0.501953, 0.964844, 0.986328, 0.183594, 0.648438, 0.304199, 0.769531}, // 60 SPR_BEAM
+    {100, 150, 0.000000, 0.000000, 1.000000, 1.000000, 0.285156, 0.273438, 0.316406, 0.460938},  // 61 SPR_ARROWR2L
+    {100, 150, 0.000000, 0.000000, 1.000000, 1.000000, 0.324219, 0.273438, 0.355469, 0.460938},  // 62 SPR_ARROWL2R
+    {20, 40, 0.000000, 0.000000, 1.000000, 1.000000, 0.042969, 0.492188, 0.058594, 0.617188},    // 63 SPR_DELI0
+    {20, 40, 0.000000, 0.000000, 1.000000, 1.000000, 0.042969, 0.632812, 0.058594, 0.757812},    // 64 SPR_DELI1
+    {256, 256, 0.000000, 0.000000, 1.000000, 1.000000, 0.785156, 0.632812, 0.816406, 0.757812},  // 65 SPR_ROAD0
+    {256, 256, 0.000000, 0.000000, 1.000000, 1.000000, 0.824219, 0.632812, 0.855469, 0.757812},  // 66 SPR_ROAD1
+    {256, 256, 0.000000, 0.000000, 1.000000, 1.000000, 0.863281, 0.632812, 0.894531, 0.757812},  // 67 SPR_ROAD2
+};